@@ -1,18 +1,119 @@
 #include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <climits>
 #include <cmath>
+#include <condition_variable>
+#include <cstdint>
+#include <cstring>
 #include <fstream>
+#include <functional>
+#include <iomanip>
 #include <iostream>
-#include <map>
+#include <limits>
 #include <memory>
+#include <mutex>
+#include <numeric>
 #include <random>
-#include <sstream>
+#include <string>
+#include <thread>
+#include <unordered_map>
 #include <vector>
 
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+/* Philox4x32-10 counter-based generator (Salmon et al., "Parallel Random
+ * Numbers: As Easy as 1, 2, 3"). Every block of four outputs is a pure
+ * function of the seed and a counter naming the island, individual,
+ * generation and block, so a stream costs a few words, starts anywhere
+ * without warm-up, and draws the same numbers on whichever thread uses it.
+ *
+ * Blocks are made `lanes` at a time in structure-of-arrays form so the
+ * rounds vectorize, then handed out from that buffer. bounded() and
+ * uniform() turn single words into draws without building a distribution.
+ */
 struct RandomGenerator {
-  std::random_device rd;
-  std::mt19937 gen;
+  typedef uint32_t result_type;
+  static constexpr result_type min() { return 0; }
+  static constexpr result_type max() { return UINT32_MAX; }
+  static constexpr unsigned int lanes = 4;
+
+  RandomGenerator(uint64_t seed = 0, uint32_t island = 0,
+                  uint32_t individual = 0, uint32_t generation = 0)
+      : key{uint32_t(seed), uint32_t(seed >> 32)},
+        counter{0, individual, generation, island}, index(4 * lanes) {}
+
+  result_type operator()() {
+    if (index == 4 * lanes) {
+      refill();
+    }
+    return output[index++];
+  }
+
+  // Uniform in [0, range) by Lemire's multiply-shift, which needs a
+  // division only on the rare draws that land in the biased sliver.
+  uint32_t bounded(uint32_t range) {
+    uint64_t m = uint64_t((*this)()) * range;
+    if (uint32_t(m) < range) {
+      uint32_t threshold = -range % range;
+      while (uint32_t(m) < threshold) {
+        m = uint64_t((*this)()) * range;
+      }
+    }
+    return m >> 32;
+  }
+
+  // Uniform in [0, 1).
+  double uniform() { return (*this)() * 0x1p-32; }
+
+  template <typename Iterator> void shuffle(Iterator begin, Iterator end) {
+    for (auto n = end - begin; n > 1; n--) {
+      std::iter_swap(begin + n - 1, begin + bounded(n));
+    }
+  }
+
+private:
+  void refill() {
+    uint32_t c0[lanes], c1[lanes], c2[lanes], c3[lanes];
+    for (unsigned int l = 0; l < lanes; l++) {
+      c0[l] = counter[0] + l;
+      c1[l] = counter[1];
+      c2[l] = counter[2];
+      c3[l] = counter[3];
+    }
+    uint32_t k0 = key[0], k1 = key[1];
+    for (int round = 0; round < 10; round++) {
+      for (unsigned int l = 0; l < lanes; l++) {
+        uint64_t p0 = uint64_t(0xD2511F53) * c0[l];
+        uint64_t p1 = uint64_t(0xCD9E8D57) * c2[l];
+        c0[l] = uint32_t(p1 >> 32) ^ c1[l] ^ k0;
+        c1[l] = uint32_t(p1);
+        c2[l] = uint32_t(p0 >> 32) ^ c3[l] ^ k1;
+        c3[l] = uint32_t(p0);
+      }
+      k0 += 0x9E3779B9;
+      k1 += 0xBB67AE85;
+    }
+    for (unsigned int l = 0; l < lanes; l++) {
+      output[4 * l] = c0[l];
+      output[4 * l + 1] = c1[l];
+      output[4 * l + 2] = c2[l];
+      output[4 * l + 3] = c3[l];
+    }
+    counter[0] += lanes;
+    index = 0;
+  }
 
-  RandomGenerator() : gen(rd()) {}
+  uint32_t key[2];
+  uint32_t counter[4];
+  uint32_t output[4 * lanes];
+  unsigned int index;
 };
 
 struct VotingDistrictId {
@@ -27,185 +128,4272 @@ struct LegDistrictId {
   LegDistrictId(int id) : id(id){};
 };
 
+// Dense 0..n-1 position of a voting district; VotingDistrictId is only
+// used for reading and writing files.
+typedef uint32_t VotingDistrictIndex;
+
 struct VotingDistrict {
   VotingDistrict(VotingDistrictId voting_district_id,
                  LegDistrictId leg_district_id)
       : voting_district_id(voting_district_id),
-        leg_district_id(leg_district_id),
-        neighbors(std::vector<VotingDistrictId>()) {}
+        leg_district_id(leg_district_id) {}
 
   VotingDistrictId voting_district_id;
   LegDistrictId leg_district_id;
   int republicans;
   int democrats;
   int other;
-  std::vector<VotingDistrictId> neighbors;
+};
+
+struct MappedFile {
+  const char *data;
+  size_t size;
+  bool opened;
+
+  MappedFile(const char *path) : data(nullptr), size(0), opened(false) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+      return;
+    }
+    opened = true;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+      void *addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (addr != MAP_FAILED) {
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        data = static_cast<const char *>(addr);
+        size = st.st_size;
+      }
+    }
+    close(fd);
+  }
+  MappedFile(const MappedFile &) = delete;
+  MappedFile &operator=(const MappedFile &) = delete;
+  ~MappedFile() {
+    if (data) {
+      munmap(const_cast<char *>(data), size);
+    }
+  }
+};
+
+// Mirrors `std::istream >> int`: skip leading whitespace and a sign, then
+// read digits. from_chars takes a '-' but not a '+', so that is skipped here.
+// Anything after the last field on a line is ignored.
+inline bool parseField(const char *&p, const char *end, int &value) {
+  while (p < end && (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\v' ||
+                     *p == '\f')) {
+    p++;
+  }
+  if (end - p > 1 && *p == '+' && p[1] >= '0' && p[1] <= '9') {
+    p++;
+  }
+  auto result = std::from_chars(p, end, value);
+  if (result.ec != std::errc()) {
+    return false;
+  }
+  p = result.ptr;
+  return true;
+}
+
+struct ParseError {
+  int line_num;
+  std::string line;
+
+  ParseError() : line_num(0) {}
+};
+
+/* Splits the mapped file into one chunk per thread on line boundaries and
+ * parses each chunk in place. Records come back in file order; on failure
+ * `error` holds the first invalid line, numbered as std::getline would. A
+ * file that cannot be opened is reported as line 0.
+ */
+template <typename Record, typename Parse>
+bool parseLines(const MappedFile &file, std::vector<Record> &records,
+                Parse parse, ParseError &error,
+                unsigned int num_threads =
+                    std::thread::hardware_concurrency()) {
+  if (!file.opened) {
+    error.line_num = 0;
+    error.line = "could not be opened";
+    return false;
+  }
+  const size_t min_chunk = 1 << 20;
+  size_t num_chunks = std::max<size_t>(1, num_threads);
+  num_chunks = std::max<size_t>(1, std::min(num_chunks, file.size / min_chunk));
+
+  std::vector<const char *> bounds(num_chunks + 1, file.data + file.size);
+  bounds[0] = file.data;
+  for (size_t c = 1; c < num_chunks; c++) {
+    const char *p =
+        std::max(bounds[c - 1], file.data + file.size / num_chunks * c);
+    while (p < file.data + file.size && p > file.data && p[-1] != '\n') {
+      p++;
+    }
+    bounds[c] = p;
+  }
+
+  struct Chunk {
+    std::vector<Record> records;
+    int lines = 0;
+    int bad_line = 0;
+    const char *bad_begin = nullptr;
+    const char *bad_end = nullptr;
+  };
+  std::vector<Chunk> chunks(num_chunks);
+
+  auto work = [&](size_t c) {
+    Chunk &chunk = chunks[c];
+    const char *p = bounds[c];
+    const char *end = bounds[c + 1];
+    while (p < end) {
+      const char *eol = static_cast<const char *>(memchr(p, '\n', end - p));
+      if (!eol) {
+        eol = end;
+      }
+      chunk.lines++;
+      if (!parse(p, eol, chunk.records)) {
+        chunk.bad_line = chunk.lines;
+        chunk.bad_begin = p;
+        chunk.bad_end = eol;
+        return;
+      }
+      p = eol + 1;
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (size_t c = 1; c < num_chunks; c++) {
+    threads.emplace_back(work, c);
+  }
+  work(0);
+  for (auto &t : threads) {
+    t.join();
+  }
+
+  int line_offset = 0;
+  size_t total = 0;
+  for (auto &chunk : chunks) {
+    if (chunk.bad_line) {
+      error.line_num = line_offset + chunk.bad_line;
+      error.line.assign(chunk.bad_begin, chunk.bad_end);
+      return false;
+    }
+    line_offset += chunk.lines;
+    total += chunk.records.size();
+  }
+
+  records.reserve(records.size() + total);
+  for (auto &chunk : chunks) {
+    std::move(chunk.records.begin(), chunk.records.end(),
+              std::back_inserter(records));
+  }
+  return true;
+}
+
+bool loadVotingDistricts(const char *path, std::vector<VotingDistrict> &vdists,
+                         ParseError &error) {
+  MappedFile file(path);
+  return parseLines(
+      file, vdists,
+      [](const char *p, const char *end, std::vector<VotingDistrict> &out) {
+        int vot_dist, leg_dist, republicans, democrats, other;
+        if (!(parseField(p, end, vot_dist) && parseField(p, end, leg_dist) &&
+              parseField(p, end, republicans) &&
+              parseField(p, end, democrats) && parseField(p, end, other))) {
+          return false;
+        }
+        out.emplace_back(vot_dist, leg_dist);
+        out.back().republicans = republicans;
+        out.back().democrats = democrats;
+        out.back().other = other;
+        return true;
+      },
+      error);
+}
+
+inline bool parsePair(const char *p, const char *end,
+                      std::vector<std::pair<int, int>> &out) {
+  int first, second;
+  if (!(parseField(p, end, first) && parseField(p, end, second))) {
+    return false;
+  }
+  out.emplace_back(first, second);
+  return true;
+}
+
+bool loadVotingDistrictNeighbors(
+    const char *path, std::vector<std::pair<int, int>> &edges,
+    ParseError &error) {
+  MappedFile file(path);
+  return parseLines(file, edges, parsePair, error);
+}
+
+// A plan file has one "voting district<TAB>legislative district" per line.
+bool loadPlanAssignments(const char *path,
+                         std::vector<std::pair<int, int>> &assignments,
+                         ParseError &error, unsigned int num_threads) {
+  MappedFile file(path);
+  return parseLines(file, assignments, parsePair, error, num_threads);
+}
+
+struct GraphFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t num_districts;
+  uint32_t num_leg_districts;
+  uint32_t num_edges;
+  uint64_t checksum;
+};
+
+inline uint64_t checksum(const uint64_t *words, size_t count) {
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (size_t i = 0; i < count; i++) {
+    hash = (hash ^ words[i]) * 0x100000001b3ULL;
+  }
+  return hash;
+}
+
+/* Voting districts remapped to dense indices 0..n-1 in file order, with
+ * per-district columns and compressed-sparse-row adjacency. The arrays live
+ * in one payload that is either owned (built from the TSV files) or mapped
+ * straight from a compiled graph file.
+ */
+struct VotingDistrictGraph {
+  static constexpr char magic[8] = {'G', 'E', 'N', 'D', 'I', 'S', 'T', 'G'};
+  static constexpr uint32_t version = 1;
+
+  uint32_t num_districts;
+  uint32_t num_leg_districts;
+  uint32_t num_edges;
+  const int32_t *voting_district_ids;
+  const int32_t *leg_district_ids;
+  const uint32_t *leg_districts;
+  const int32_t *republicans;
+  const int32_t *democrats;
+  const int32_t *other;
+  const uint32_t *offsets;
+  const VotingDistrictIndex *targets;
+
+  VotingDistrictGraph()
+      : num_districts(0), num_leg_districts(0), num_edges(0),
+        voting_district_ids(nullptr), leg_district_ids(nullptr),
+        leg_districts(nullptr), republicans(nullptr), democrats(nullptr),
+        other(nullptr), offsets(nullptr), targets(nullptr) {}
+  VotingDistrictGraph(const VotingDistrictGraph &) = delete;
+  VotingDistrictGraph &operator=(const VotingDistrictGraph &) = delete;
+
+  const VotingDistrictIndex *neighborsBegin(VotingDistrictIndex vdist) const {
+    return targets + offsets[vdist];
+  }
+  const VotingDistrictIndex *neighborsEnd(VotingDistrictIndex vdist) const {
+    return targets + offsets[vdist + 1];
+  }
+  uint32_t degree(VotingDistrictIndex vdist) const {
+    return offsets[vdist + 1] - offsets[vdist];
+  }
+
+  uint64_t fingerprint() const { return checksum(payload, payload_words); }
+
+  /* Neighbor pairs are made symmetric, deduplicated and stripped of
+   * self-loops. Returns the 1-based line of the first record that is a
+   * duplicate district (-line for an unknown neighbor), or 0.
+   */
+  int build(const std::vector<VotingDistrict> &records,
+            const std::vector<std::pair<int, int>> &edges) {
+    std::unordered_map<int, uint32_t> index;
+    index.reserve(records.size());
+    std::vector<int32_t> leg_ids;
+    for (size_t i = 0; i < records.size(); i++) {
+      if (!index.emplace(records[i].voting_district_id.id, i).second) {
+        return i + 1;
+      }
+      leg_ids.push_back(records[i].leg_district_id.id);
+    }
+    std::sort(leg_ids.begin(), leg_ids.end());
+    leg_ids.erase(std::unique(leg_ids.begin(), leg_ids.end()), leg_ids.end());
+
+    uint32_t n = records.size();
+    std::vector<uint32_t> degrees(n + 1, 0);
+    std::vector<std::pair<uint32_t, uint32_t>> pairs;
+    pairs.reserve(edges.size());
+    for (size_t i = 0; i < edges.size(); i++) {
+      auto a = index.find(edges[i].first);
+      auto b = index.find(edges[i].second);
+      if (a == index.end() || b == index.end()) {
+        return -static_cast<int>(i + 1);
+      }
+      if (a->second != b->second) {
+        pairs.emplace_back(a->second, b->second);
+        degrees[a->second + 1]++;
+        degrees[b->second + 1]++;
+      }
+    }
+    std::partial_sum(degrees.begin(), degrees.end(), degrees.begin());
+    std::vector<uint32_t> adjacency(degrees[n]);
+    std::vector<uint32_t> fill(degrees.begin(), degrees.end() - 1);
+    for (auto &pair : pairs) {
+      adjacency[fill[pair.first]++] = pair.second;
+      adjacency[fill[pair.second]++] = pair.first;
+    }
+    uint32_t m = 0;
+    for (uint32_t v = 0; v < n; v++) {
+      auto begin = adjacency.begin() + degrees[v];
+      auto end = adjacency.begin() + degrees[v + 1];
+      std::sort(begin, end);
+      end = std::unique(begin, end);
+      degrees[v] = m;
+      m = std::copy(begin, end, adjacency.begin() + m) - adjacency.begin();
+    }
+    degrees[n] = m;
+
+    allocate(n, leg_ids.size(), m);
+    std::copy(leg_ids.begin(), leg_ids.end(), writable(leg_district_ids));
+    for (uint32_t v = 0; v < n; v++) {
+      writable(voting_district_ids)[v] = records[v].voting_district_id.id;
+      writable(leg_districts)[v] =
+          std::lower_bound(leg_ids.begin(), leg_ids.end(),
+                           records[v].leg_district_id.id) -
+          leg_ids.begin();
+      writable(republicans)[v] = records[v].republicans;
+      writable(democrats)[v] = records[v].democrats;
+      writable(other)[v] = records[v].other;
+    }
+    std::copy(degrees.begin(), degrees.end(), writable(offsets));
+    std::copy(adjacency.begin(), adjacency.begin() + m, writable(targets));
+    return 0;
+  }
+
+  bool write(const std::string &path) const {
+    GraphFileHeader header;
+    std::copy(magic, magic + sizeof(magic), header.magic);
+    header.version = version;
+    header.num_districts = num_districts;
+    header.num_leg_districts = num_leg_districts;
+    header.num_edges = num_edges;
+    header.checksum = checksum(payload, payload_words);
+
+    std::string tmp_path = path + ".tmp";
+    std::ofstream out(tmp_path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char *>(payload),
+              payload_words * sizeof(uint64_t));
+    out.close();
+    return out && std::rename(tmp_path.c_str(), path.c_str()) == 0;
+  }
+
+  bool read(const std::string &path) {
+    file.reset(new MappedFile(path.c_str()));
+    if (file->size < sizeof(GraphFileHeader)) {
+      return false;
+    }
+    GraphFileHeader header;
+    std::memcpy(&header, file->data, sizeof(header));
+    if (!std::equal(magic, magic + sizeof(magic), header.magic) ||
+        header.version != version ||
+        file->size != sizeof(header) +
+                          payloadWords(header.num_districts,
+                                       header.num_leg_districts,
+                                       header.num_edges) *
+                              sizeof(uint64_t)) {
+      return false;
+    }
+    auto words =
+        reinterpret_cast<const uint64_t *>(file->data + sizeof(header));
+    if (checksum(words, file->size / sizeof(uint64_t) -
+                            sizeof(header) / sizeof(uint64_t)) !=
+        header.checksum) {
+      return false;
+    }
+    bind(words, header.num_districts, header.num_leg_districts,
+         header.num_edges);
+    return true;
+  }
+
+private:
+  template <typename T> static T *writable(const T *column) {
+    return const_cast<T *>(column);
+  }
+  static size_t words(size_t count, size_t size) {
+    return (count * size + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+  }
+  static size_t payloadWords(size_t n, size_t k, size_t m) {
+    return words(n, 4) * 6 + words(k, 4) + words(n + 1, 4) + words(m, 4);
+  }
+
+  void allocate(uint32_t n, uint32_t k, uint32_t m) {
+    storage.assign(payloadWords(n, k, m), 0);
+    bind(storage.data(), n, k, m);
+  }
+
+  void bind(const uint64_t *words_begin, uint32_t n, uint32_t k, uint32_t m) {
+    num_districts = n;
+    num_leg_districts = k;
+    num_edges = m;
+    payload = words_begin;
+    payload_words = payloadWords(n, k, m);
+
+    const uint64_t *p = words_begin;
+    auto next = [&](size_t count) {
+      auto column = p;
+      p += words(count, 4);
+      return column;
+    };
+    voting_district_ids = reinterpret_cast<const int32_t *>(next(n));
+    leg_district_ids = reinterpret_cast<const int32_t *>(next(k));
+    leg_districts = reinterpret_cast<const uint32_t *>(next(n));
+    republicans = reinterpret_cast<const int32_t *>(next(n));
+    democrats = reinterpret_cast<const int32_t *>(next(n));
+    other = reinterpret_cast<const int32_t *>(next(n));
+    offsets = reinterpret_cast<const uint32_t *>(next(n + 1));
+    targets = reinterpret_cast<const VotingDistrictIndex *>(next(m));
+  }
+
+  const uint64_t *payload = nullptr;
+  size_t payload_words = 0;
+  std::vector<uint64_t> storage;
+  std::unique_ptr<MappedFile> file;
 };
 
 template <typename Gene> struct GeneticAlgorithmType {
   typedef std::vector<std::shared_ptr<Gene>> Individual;
   typedef std::vector<Individual> Population;
+  typedef std::shared_ptr<Gene> Allele;
+};
+
+// Gene of a redistricting plan: the dense legislative district a precinct
+// is assigned to, stored as uint8_t or uint16_t depending on district count.
+template <typename LegIndex> struct PrecinctGene {};
+
+// The district file has no census counts, so votes cast stand in for
+// population.
+struct DistrictTotals {
+  int64_t republicans;
+  int64_t democrats;
+  int64_t other;
+  uint32_t precincts;
+
+  DistrictTotals() : republicans(0), democrats(0), other(0), precincts(0) {}
+
+  int64_t population() const { return republicans + democrats + other; }
+
+  void add(const VotingDistrictGraph &graph, VotingDistrictIndex vdist) {
+    republicans += graph.republicans[vdist];
+    democrats += graph.democrats[vdist];
+    other += graph.other[vdist];
+    precincts++;
+  }
+  void remove(const VotingDistrictGraph &graph, VotingDistrictIndex vdist) {
+    republicans -= graph.republicans[vdist];
+    democrats -= graph.democrats[vdist];
+    other -= graph.other[vdist];
+    precincts--;
+  }
+};
+
+/* Zobrist key for a precinct sitting in a district; a plan's hash is the
+ * XOR of the keys of all its precincts, so a reassignment updates it with
+ * two XORs. Keys come from the splitmix64 finalizer rather than a table,
+ * which would need one entry per precinct and district.
+ */
+inline uint64_t zobristKey(VotingDistrictIndex vdist, uint32_t leg) {
+  uint64_t x = ((uint64_t(vdist) << 16 | leg) + 1) * 0x9E3779B97F4A7C15;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EB;
+  return x ^ (x >> 31);
+}
+
+/* A set of voting districts with O(1) insert, erase and uniform sampling:
+ * members are packed at the front of one array and every district's slot in
+ * it is kept in another. Views rows owned by a PlanPopulation.
+ */
+struct VotingDistrictSet {
+  static constexpr VotingDistrictIndex absent =
+      std::numeric_limits<VotingDistrictIndex>::max();
+
+  VotingDistrictIndex *members;
+  VotingDistrictIndex *positions;
+  uint32_t *count;
+
+  VotingDistrictSet(VotingDistrictIndex *members,
+                    VotingDistrictIndex *positions, uint32_t *count)
+      : members(members), positions(positions), count(count) {}
+
+  uint32_t size() const { return *count; }
+  VotingDistrictIndex operator[](uint32_t i) const { return members[i]; }
+  bool contains(VotingDistrictIndex vdist) const {
+    return positions[vdist] != absent;
+  }
+
+  void insert(VotingDistrictIndex vdist) {
+    if (contains(vdist)) {
+      return;
+    }
+    positions[vdist] = *count;
+    members[(*count)++] = vdist;
+  }
+
+  void erase(VotingDistrictIndex vdist) {
+    if (!contains(vdist)) {
+      return;
+    }
+    VotingDistrictIndex last = members[--(*count)];
+    members[positions[vdist]] = last;
+    positions[last] = positions[vdist];
+    positions[vdist] = absent;
+  }
+
+  void clear(size_t num_districts) {
+    std::fill(positions, positions + num_districts, absent);
+    *count = 0;
+  }
+};
+
+/* One legislative district index per voting district, in dense voting
+ * district order, plus running totals for each legislative district and the
+ * set of precincts with a neighbor in another district. A plan is a view of
+ * one row of a PlanPopulation; vote counts and adjacency stay in the shared
+ * read-only graph. Reassignments go through assign() so the totals, the
+ * boundary and the plan's Zobrist hash stay current.
+ */
+template <typename LegIndex> struct DistrictPlan {
+  typedef LegIndex *iterator;
+  typedef const LegIndex *const_iterator;
+
+  const VotingDistrictGraph *graph;
+  LegIndex *assignment;
+  DistrictTotals *totals;
+  VotingDistrictSet boundary;
+  uint64_t *hash;
+
+  DistrictPlan(const VotingDistrictGraph *graph, LegIndex *assignment,
+               DistrictTotals *totals, VotingDistrictSet boundary,
+               uint64_t *hash)
+      : graph(graph), assignment(assignment), totals(totals),
+        boundary(boundary), hash(hash) {}
+
+  size_t size() const { return graph->num_districts; }
+  size_t numLegDistricts() const { return graph->num_leg_districts; }
+  LegIndex operator[](VotingDistrictIndex vdist) const {
+    return assignment[vdist];
+  }
+  const_iterator begin() const { return assignment; }
+  const_iterator end() const { return assignment + size(); }
+
+  void assign(VotingDistrictIndex vdist, LegIndex to) {
+    LegIndex from = assignment[vdist];
+    if (from == to) {
+      return;
+    }
+    totals[from].remove(*graph, vdist);
+    totals[to].add(*graph, vdist);
+    *hash ^= zobristKey(vdist, from) ^ zobristKey(vdist, to);
+    assignment[vdist] = to;
+    updateBoundary(vdist);
+    for (auto n = graph->neighborsBegin(vdist); n < graph->neighborsEnd(vdist);
+         n++) {
+      updateBoundary(*n);
+    }
+  }
+
+  bool isBoundary(VotingDistrictIndex vdist) const {
+    for (auto n = graph->neighborsBegin(vdist); n < graph->neighborsEnd(vdist);
+         n++) {
+      if (assignment[*n] != assignment[vdist]) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // A uniformly random boundary precinct; the boundary must not be empty.
+  VotingDistrictIndex randomBoundary(RandomGenerator &rng) const {
+    return boundary[rng.bounded(boundary.size())];
+  }
+
+  // The district of a uniformly random neighbor of boundary precinct vdist
+  // that lies in another district.
+  LegIndex randomNeighborDistrict(VotingDistrictIndex vdist,
+                                  RandomGenerator &rng) const {
+    uint32_t foreign = 0;
+    for (auto n = graph->neighborsBegin(vdist); n < graph->neighborsEnd(vdist);
+         n++) {
+      foreign += assignment[*n] != assignment[vdist];
+    }
+    uint32_t pick = rng.bounded(foreign);
+    for (auto n = graph->neighborsBegin(vdist);; n++) {
+      if (assignment[*n] != assignment[vdist] && pick-- == 0) {
+        return assignment[*n];
+      }
+    }
+  }
+
+  void updateBoundary(VotingDistrictIndex vdist) {
+    if (isBoundary(vdist)) {
+      boundary.insert(vdist);
+    } else {
+      boundary.erase(vdist);
+    }
+  }
+
+  void swap(DistrictPlan &other, VotingDistrictIndex begin,
+            VotingDistrictIndex end) {
+    for (VotingDistrictIndex vdist = begin; vdist < end; vdist++) {
+      LegIndex mine = assignment[vdist];
+      LegIndex theirs = other.assignment[vdist];
+      if (mine != theirs) {
+        assign(vdist, theirs);
+        other.assign(vdist, mine);
+      }
+    }
+  }
+
+  void tally() {
+    std::fill(totals, totals + numLegDistricts(), DistrictTotals());
+    boundary.clear(size());
+    *hash = 0;
+    for (VotingDistrictIndex vdist = 0; vdist < size(); vdist++) {
+      totals[assignment[vdist]].add(*graph, vdist);
+      updateBoundary(vdist);
+      *hash ^= zobristKey(vdist, assignment[vdist]);
+    }
+  }
+};
+
+template <typename Individual>
+void swapGenes(Individual &a, Individual &b, size_t begin, size_t end) {
+  std::swap_ranges(a.begin() + begin, a.begin() + end, b.begin() + begin);
+}
+
+template <typename LegIndex>
+void swapGenes(DistrictPlan<LegIndex> &a, DistrictPlan<LegIndex> &b,
+               size_t begin, size_t end) {
+  a.swap(b, begin, end);
+}
+
+// Zobrist hash of an individual, or 0 for individuals that keep none.
+template <typename Individual> uint64_t geneHash(const Individual &indiv) {
+  return 0;
+}
+
+template <typename LegIndex>
+uint64_t geneHash(const DistrictPlan<LegIndex> &plan) {
+  return *plan.hash;
+}
+
+// Whether an individual still has the hash it was copied with, so a mutation
+// that found no move or a crossover of equal parents needs no rescoring.
+// Without a hash every touched individual counts as changed.
+template <typename Individual>
+bool unchanged(const Individual &indiv, uint64_t origin) {
+  return origin && geneHash(indiv) == origin;
+}
+
+template <typename Individual, typename Allele>
+void setGene(Individual &indiv, size_t locus, const Allele &allele) {
+  indiv[locus] = allele;
+}
+
+template <typename LegIndex>
+void setGene(DistrictPlan<LegIndex> &plan, size_t locus, LegIndex leg) {
+  plan.assign(locus, leg);
+}
+
+/* Every plan of a population in one population-by-precinct buffer, with the
+ * district totals and boundary sets in parallel buffers. The
+ * GeneticAlgorithm keeps two and breeds each generation from one into the
+ * other, so steady state allocates nothing.
+ */
+template <typename LegIndex> struct PlanPopulation {
+  PlanPopulation(const VotingDistrictGraph &graph, size_t size)
+      : graph(&graph), num_plans(size),
+        assignments(size * graph.num_districts),
+        totals(size * graph.num_leg_districts),
+        boundaries(size * graph.num_districts),
+        boundary_positions(size * graph.num_districts), boundary_sizes(size),
+        hashes(size) {
+    for (size_t i = 0; i < size; i++) {
+      auto plan = (*this)[i];
+      std::copy(graph.leg_districts, graph.leg_districts + graph.num_districts,
+                plan.assignment);
+      plan.tally();
+    }
+  }
+
+  PlanPopulation(const DistrictPlan<LegIndex> &prototype, size_t size)
+      : graph(prototype.graph), num_plans(size),
+        assignments(size * prototype.size()),
+        totals(size * prototype.numLegDistricts()),
+        boundaries(size * prototype.size()),
+        boundary_positions(size * prototype.size()), boundary_sizes(size),
+        hashes(size, *prototype.hash) {
+    for (size_t i = 0; i < size; i++) {
+      auto plan = (*this)[i];
+      std::copy(prototype.begin(), prototype.end(), plan.assignment);
+      std::copy(prototype.totals, prototype.totals + plan.numLegDistricts(),
+                plan.totals);
+      std::copy(prototype.boundary.members,
+                prototype.boundary.members + prototype.boundary.size(),
+                plan.boundary.members);
+      std::copy(prototype.boundary.positions,
+                prototype.boundary.positions + prototype.size(),
+                plan.boundary.positions);
+      *plan.boundary.count = prototype.boundary.size();
+    }
+  }
+
+  size_t size() const { return num_plans; }
+
+  DistrictPlan<LegIndex> operator[](size_t i) {
+    size_t n = graph->num_districts;
+    return DistrictPlan<LegIndex>(
+        graph, assignments.data() + i * n,
+        totals.data() + i * graph->num_leg_districts,
+        VotingDistrictSet(boundaries.data() + i * n,
+                          boundary_positions.data() + i * n,
+                          boundary_sizes.data() + i),
+        hashes.data() + i);
+  }
+
+  void load(size_t i, const LegIndex *assignment) {
+    auto plan = (*this)[i];
+    std::copy(assignment, assignment + graph->num_districts, plan.assignment);
+    plan.tally();
+  }
+
+  void copy(size_t i, const PlanPopulation &from, size_t j) {
+    size_t n = graph->num_districts;
+    size_t k = graph->num_leg_districts;
+    std::memcpy(assignments.data() + i * n, from.assignments.data() + j * n,
+                n * sizeof(LegIndex));
+    std::copy_n(from.totals.data() + j * k, k, totals.data() + i * k);
+    std::copy_n(from.boundaries.data() + j * n, from.boundary_sizes[j],
+                boundaries.data() + i * n);
+    std::copy_n(from.boundary_positions.data() + j * n, n,
+                boundary_positions.data() + i * n);
+    boundary_sizes[i] = from.boundary_sizes[j];
+    hashes[i] = from.hashes[j];
+  }
+
+  void swap(PlanPopulation &other) {
+    std::swap(graph, other.graph);
+    std::swap(num_plans, other.num_plans);
+    assignments.swap(other.assignments);
+    totals.swap(other.totals);
+    boundaries.swap(other.boundaries);
+    boundary_positions.swap(other.boundary_positions);
+    boundary_sizes.swap(other.boundary_sizes);
+    hashes.swap(other.hashes);
+  }
+
+private:
+  const VotingDistrictGraph *graph;
+  size_t num_plans;
+  std::vector<LegIndex> assignments;
+  std::vector<DistrictTotals> totals;
+  std::vector<VotingDistrictIndex> boundaries;
+  std::vector<VotingDistrictIndex> boundary_positions;
+  std::vector<uint32_t> boundary_sizes;
+  std::vector<uint64_t> hashes;
+};
+
+template <typename LegIndex>
+struct GeneticAlgorithmType<PrecinctGene<LegIndex>> {
+  typedef DistrictPlan<LegIndex> Individual;
+  typedef PlanPopulation<LegIndex> Population;
+  typedef LegIndex Allele;
 };
 
+// Crossers and mutators draw only from the stream they are handed, which
+// GeneticAlgorithm keys to the individual and generation being bred.
 template <typename Gene> struct Crosser {
+  virtual ~Crosser() = default;
   virtual void operator()(typename GeneticAlgorithmType<Gene>::Individual &a,
-                          typename GeneticAlgorithmType<Gene>::Individual &b);
+                          typename GeneticAlgorithmType<Gene>::Individual &b,
+                          RandomGenerator &rng) = 0;
 };
 
 template <typename Gene> struct Mutator {
-  virtual typename GeneticAlgorithmType<Gene>::Individual
-  operator()(typename GeneticAlgorithmType<Gene>::Individual &vdist);
+  virtual ~Mutator() = default;
+  virtual void
+  operator()(typename GeneticAlgorithmType<Gene>::Individual &vdist,
+             RandomGenerator &rng) = 0;
 };
 
+// Scores one individual; lower scores are better. GeneticAlgorithm calls it
+// from several threads at once, so it must not modify shared state.
 template <typename Gene> struct Objective {
-  virtual int
-  operator()(typename GeneticAlgorithmType<Gene>::Population population);
+  typedef typename GeneticAlgorithmType<Gene>::Individual Individual;
+  typedef typename GeneticAlgorithmType<Gene>::Allele Allele;
+
+  virtual ~Objective() = default;
+  virtual int operator()(const Individual &indiv) = 0;
+
+  /* Change in score if gene `locus` of indiv went from `from` to `to`,
+   * leaving indiv as it was. This fallback makes the move, rescores and
+   * undoes it; objectives that can price a move locally override it.
+   */
+  virtual int64_t delta(Individual &indiv, size_t locus, Allele from,
+                        Allele to) {
+    int64_t before = (*this)(indiv);
+    setGene(indiv, locus, to);
+    int64_t after = (*this)(indiv);
+    setGene(indiv, locus, from);
+    return after - before;
+  }
+
+  // Called by the owner of indiv once the move has been made, for
+  // objectives that keep state per individual.
+  virtual void commit(const Individual &indiv, size_t locus, Allele from,
+                      Allele to) {}
+};
+
+// Several scores for one individual, each to be minimized. Like Objective
+// it is called from several threads at once.
+template <typename Gene> struct MultiObjective {
+  typedef typename GeneticAlgorithmType<Gene>::Individual Individual;
+
+  virtual ~MultiObjective() = default;
+  virtual size_t size() const = 0;
+  virtual const char *name(size_t m) const = 0;
+  virtual void operator()(const Individual &indiv, int64_t *scores) = 0;
 };
 
 template <typename T> T clamp(T a, T n, T x) {
   return std::max(std::min(a, x), n);
 }
 
-struct GeneticAlgorithmConfig {
-  unsigned int population_size;
-  double mutation_rate;
-  double crossover_rate;
-
-  GeneticAlgorithmConfig(unsigned int population_size, double mutation_rate,
-                         double crossover_rate)
-      : population_size(population_size), mutation_rate(mutation_rate),
-        crossover_rate(crossover_rate) {}
+/* Picks parents by slot from a generation's scores. prepare() is called
+ * once per generation, before any picks, so that each pick is then O(1),
+ * or O(k) for a k-tournament.
+ */
+struct Selector {
+  virtual ~Selector() = default;
+  virtual void prepare(const std::vector<int> &scores) {}
+  virtual size_t operator()(const std::vector<int> &scores,
+                            RandomGenerator &rng) = 0;
 };
 
-template <typename Gene> struct GeneticAlgorithm {
-  typedef std::vector<std::shared_ptr<Gene>> Individual;
-  typedef std::vector<Individual> Population;
-
-  Population population;
-  GeneticAlgorithmConfig config;
-  unsigned int num_mutate;
-  unsigned int num_crossover;
-  static thread_local RandomGenerator rng;
-  GeneticAlgorithm(Individual prototype, GeneticAlgorithmConfig config,
-                   Objective<Gene> objective, Crosser<Gene> crosser,
-                   Mutator<Gene> mutator)
-      : objective(objective), crosser(crosser), mutator(mutator),
-        config(config) {
-    for (int i = 0; i < config.population_size; i++) {
-      population.push_back(prototype);
-    }
-    num_mutate = static_cast<unsigned int>(
-        std::ceil(config.mutation_rate * population.size()));
-    num_crossover = static_cast<unsigned int>(
-        std::ceil(config.crossover_rate * population.size()));
+// Walker's alias method, built in O(n) by Vose's construction.
+struct AliasTable {
+  void build(const std::vector<double> &weights) {
+    size_t n = weights.size();
+    double total = std::accumulate(weights.begin(), weights.end(), 0.0);
+    probability.resize(n);
+    alias.resize(n);
+    small.clear();
+    large.clear();
+    for (uint32_t i = 0; i < n; i++) {
+      alias[i] = i;
+      probability[i] = total > 0 ? weights[i] * n / total : 1;
+      (probability[i] < 1 ? small : large).push_back(i);
+    }
+    while (!small.empty() && !large.empty()) {
+      uint32_t s = small.back();
+      uint32_t l = large.back();
+      small.pop_back();
+      alias[s] = l;
+      probability[l] -= 1 - probability[s];
+      if (probability[l] < 1) {
+        large.pop_back();
+        small.push_back(l);
+      }
+    }
+    // Whatever is left over is 1 up to rounding.
+    for (uint32_t i : small) {
+      probability[i] = 1;
+    }
+    for (uint32_t i : large) {
+      probability[i] = 1;
+    }
   }
 
-  void generation() {
-    Population new_pop(population.size());
-    std::shuffle(population.begin(), population.end(), rng.gen);
-    std::transform(population.begin(), population.begin() + num_mutate, new_pop.begin(), mutator);
-    std::shuffle(new_pop.begin(), new_pop.end(), rng.gen);
-    for (auto it = new_pop.begin(); it < new_pop.begin() + num_crossover - 1;
-         it += 2) {
-      crosser(*it, *(it + 1));
-    }
+  size_t operator()(RandomGenerator &rng) const {
+    uint32_t i = rng.bounded(probability.size());
+    return rng.uniform() < probability[i] ? i : alias[i];
   }
 
 private:
-  Objective<Gene> objective;
-  Crosser<Gene> crosser;
-  Mutator<Gene> mutator;
+  std::vector<double> probability;
+  std::vector<uint32_t> alias;
+  std::vector<uint32_t> small;
+  std::vector<uint32_t> large;
 };
 
-struct VotingDistrictMutator : Mutator<VotingDistrict> {
-  static thread_local RandomGenerator rng;
-  using DistrictLookup =
-      std::map<VotingDistrictId, std::shared_ptr<VotingDistrict>>;
+// Best of k slots drawn with replacement.
+struct TournamentSelector final : Selector {
+  unsigned int k;
+
+  TournamentSelector(unsigned int k) : k(std::max(1u, k)) {}
 
-  const DistrictLookup vdists;
+  size_t operator()(const std::vector<int> &scores, RandomGenerator &rng) {
+    size_t best = rng.bounded(scores.size());
+    for (unsigned int i = 1; i < k; i++) {
+      size_t other = rng.bounded(scores.size());
+      if (scores[other] < scores[best]) {
+        best = other;
+      }
+    }
+    return best;
+  }
+};
 
-  VotingDistrictMutator(const DistrictLookup vdists) : vdists(vdists) {}
+// Linear ranking: the best slot is picked `pressure` times as often as the
+// median and the worst 2 - pressure times, for pressure in [1, 2].
+struct RankSelector final : Selector {
+  double pressure;
 
+  RankSelector(double pressure = 1.5) : pressure(clamp(pressure, 1.0, 2.0)) {}
 
-  typename GeneticAlgorithmType<VotingDistrict>::Individual
-  operator()(typename GeneticAlgorithmType<VotingDistrict>::Individual indiv) {
-    std::uniform_int_distribution<> iudist(0, indiv.size() - 1);
-    auto vdist = indiv.at(iudist(rng.gen));
-    std::uniform_int_distribution<> vudist(0, vdist->neighbors.size() - 1);
-    auto other_vdist = vdist->neighbors.at(vudist(rng.gen));
-    vdist->leg_district_id = vdists.at(other_vdist)->leg_district_id;
+  void prepare(const std::vector<int> &scores) {
+    size_t n = scores.size();
+    ranks.resize(n);
+    std::iota(ranks.begin(), ranks.end(), 0);
+    std::sort(ranks.begin(), ranks.end(), [&scores](size_t a, size_t b) {
+      return scores[a] < scores[b];
+    });
+    weights.resize(n);
+    for (size_t r = 0; r < n; r++) {
+      weights[ranks[r]] =
+          n > 1 ? pressure - 2 * (pressure - 1) * r / (n - 1) : 1;
+    }
+    table.build(weights);
+  }
 
-    return indiv;
+  size_t operator()(const std::vector<int> &scores, RandomGenerator &rng) {
+    return table(rng);
   }
+
+private:
+  std::vector<size_t> ranks;
+  std::vector<double> weights;
+  AliasTable table;
 };
 
-template <typename Gene> struct GenericCrosser : Crosser<Gene> {
-  static thread_local RandomGenerator rng;
+// Roulette wheel on how far each score is below the worst, plus one so the
+// worst slot keeps a small chance.
+struct ProportionalSelector final : Selector {
+  void prepare(const std::vector<int> &scores) {
+    int worst = *std::max_element(scores.begin(), scores.end());
+    weights.resize(scores.size());
+    for (size_t i = 0; i < scores.size(); i++) {
+      weights[i] = double(worst) - scores[i] + 1;
+    }
+    table.build(weights);
+  }
 
-  void operator()(typename GeneticAlgorithmType<Gene>::Individual &a,
-                  typename GeneticAlgorithmType<Gene>::Individual &b) {
-    std::uniform_int_distribution<> dist(0, a.size() - 1);
-    auto offset = dist(rng.gen);
-    std::swap_ranges(a.begin() + offset, a.end(), b.begin() + offset);
+  size_t operator()(const std::vector<int> &scores, RandomGenerator &rng) {
+    return table(rng);
   }
+
+private:
+  std::vector<double> weights;
+  AliasTable table;
 };
 
-struct VotingDistrictObjective : Objective<VotingDistrict> {
-  int operator()(
-      typename GeneticAlgorithmType<VotingDistrict>::Population population) {
-    return 0;
+/* Pareto fronts and crowding distances over n points of m objectives,
+ * stored row by row. sort() is Jensen's divide and conquer as generalized
+ * by Fortin et al. and Buzdalov and Shalyto ("A Provably Asymptotically
+ * Fast Version of the Generalized Jensen Algorithm for Non-dominated
+ * Sorting"), O(n log^(m-1) n) however many points share a front. Points
+ * are taken in lexicographic order, so a point can only be dominated by
+ * points before it; ranks are raised from lower bounds by splitting on the
+ * median of the last objective still in play, and the last two objectives
+ * are finished by a sweep over a max Fenwick tree. Identical points share
+ * a rank.
+ */
+struct ParetoSorter {
+  std::vector<std::vector<uint32_t>> fronts;
+  std::vector<uint32_t> rank;
+  std::vector<double> crowding;
+
+  void sort(const int64_t *values, size_t n, size_t m) {
+    this->values = values;
+    this->m = m;
+    order.resize(n);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(order.begin(), order.end(), [values, m](uint32_t a, uint32_t b) {
+      return std::lexicographical_compare(values + a * m, values + a * m + m,
+                                          values + b * m, values + b * m + m);
+    });
+    rank.assign(n, 0);
+    position.resize(n);
+    std::vector<uint32_t> points;
+    for (size_t i = 0; i < n; i++) {
+      position[order[i]] = i;
+      if (i == 0 || !same(order[i - 1], order[i])) {
+        points.push_back(order[i]);
+      }
+    }
+    if (m == 1) {
+      for (size_t i = 0; i < points.size(); i++) {
+        rank[points[i]] = i;
+      }
+    } else if (m > 1) {
+      splitA(points, m - 1);
+    }
+
+    for (auto &front : fronts) {
+      front.clear();
+    }
+    size_t num_fronts = 0;
+    for (size_t i = 0; i < n; i++) {
+      uint32_t p = order[i];
+      if (i > 0 && same(order[i - 1], p)) {
+        rank[p] = rank[order[i - 1]];
+      }
+      num_fronts = std::max<size_t>(num_fronts, rank[p] + 1);
+      if (fronts.size() < num_fronts) {
+        fronts.resize(num_fronts);
+      }
+      fronts[rank[p]].push_back(p);
+    }
+    fronts.resize(num_fronts);
   }
-};
 
-int main(int argc, char **argv) {
-  std::string line;
-  std::ifstream voting_district_file("voting_districts.tsv");
-
-  using DistrictLookup =
-      std::map<VotingDistrictId, std::shared_ptr<VotingDistrict>>;
-  auto voting_districts = DistrictLookup();
-  auto prototype = GeneticAlgorithm<VotingDistrict>::Individual();
-  int line_num = 0;
-  while (std::getline(voting_district_file, line)) {
-    line_num++;
-    std::istringstream iss(line);
-    int vot_dist, leg_dist, republicans, democrats, other;
-    if (!(iss >> vot_dist >> leg_dist >> republicans >> democrats >> other)) {
-      std::cerr << "District File: Line " << line_num << " is invalid"
-                << std::endl
-                << line << std::endl;
-      return -2;
+  /* Crowding distance of every point within its front: per objective, the
+   * gap between its neighbors in that objective over the front's range,
+   * summed. The ends of each front are infinitely far.
+   */
+  void crowd(const int64_t *values, size_t n, size_t m) {
+    crowding.assign(n, 0);
+    for (auto &front : fronts) {
+      size_t size = front.size();
+      if (size < 3) {
+        for (uint32_t p : front) {
+          crowding[p] = std::numeric_limits<double>::infinity();
+        }
+        continue;
+      }
+      for (size_t k = 0; k < m; k++) {
+        sorted.assign(front.begin(), front.end());
+        std::sort(sorted.begin(), sorted.end(),
+                  [values, m, k](uint32_t a, uint32_t b) {
+                    return values[a * m + k] < values[b * m + k];
+                  });
+        column.resize(size);
+        for (size_t j = 0; j < size; j++) {
+          column[j] = values[sorted[j] * m + k];
+        }
+        double range = column[size - 1] - column[0];
+        crowding[sorted[0]] = std::numeric_limits<double>::infinity();
+        crowding[sorted[size - 1]] = std::numeric_limits<double>::infinity();
+        if (range <= 0) {
+          continue;
+        }
+        gaps.resize(size);
+        for (size_t j = 1; j + 1 < size; j++) {
+          gaps[j] = (column[j + 1] - column[j - 1]) / range;
+        }
+        for (size_t j = 1; j + 1 < size; j++) {
+          crowding[sorted[j]] += gaps[j];
+        }
+      }
     }
+  }
 
-    auto voting_district = std::make_shared<VotingDistrict>(vot_dist, leg_dist);
-    voting_district->republicans = republicans;
-    voting_district->democrats = democrats;
-    voting_district->other = other;
-    voting_districts.insert(
-        DistrictLookup::value_type(vot_dist, voting_district));
-    prototype.push_back(voting_district);
-  }
-
-  std::ifstream voting_district_neigbors_file("voting_district_neigbors.tsv");
-  line_num = 0;
-  while (std::getline(voting_district_neigbors_file, line)) {
-    line_num++;
-    std::istringstream iss(line);
-    int vot_dist, neighbor;
-    if (!(iss >> vot_dist >> neighbor)) {
-      std::cerr << "Neighbor File: Line " << line_num << " is invalid"
-                << std::endl
-                << line << std::endl;
-      return -3;
+private:
+  // Below this many points (or pairs) a split costs more than brute force.
+  static constexpr size_t brute = 16;
+
+  bool same(uint32_t a, uint32_t b) const {
+    return std::equal(values + a * m, values + a * m + m, values + b * m);
+  }
+
+  // Whether a is no worse than b in objectives 0..k.
+  bool covers(uint32_t a, uint32_t b, size_t k) const {
+    for (size_t j = 0; j <= k; j++) {
+      if (values[a * m + j] > values[b * m + j]) {
+        return false;
+      }
     }
-    voting_districts.at(vot_dist)->neighbors.push_back(neighbor);
+    return true;
+  }
+
+  void raise(uint32_t p, uint32_t by) {
+    rank[p] = std::max(rank[p], rank[by] + 1);
   }
 
-  auto ga = GeneticAlgorithm<VotingDistrict>(
-      prototype, GeneticAlgorithmConfig(10, 0.1, 0.5),
-      VotingDistrictObjective(),
-      GenericCrosser<VotingDistrict>(),
-      VotingDistrictMutator(voting_districts));
+  int64_t median(const std::vector<uint32_t> &points, size_t k) {
+    keys.resize(points.size());
+    for (size_t i = 0; i < points.size(); i++) {
+      keys[i] = values[points[i] * m + k];
+    }
+    std::nth_element(keys.begin(), keys.begin() + keys.size() / 2, keys.end());
+    return keys[keys.size() / 2];
+  }
 
-  ga.generation();
+  // Splits points, keeping their order, by objective k against pivot.
+  void partition(const std::vector<uint32_t> &points, size_t k, int64_t pivot,
+                 std::vector<uint32_t> &below, std::vector<uint32_t> &at,
+                 std::vector<uint32_t> &above) const {
+    for (uint32_t p : points) {
+      int64_t v = values[p * m + k];
+      (v < pivot ? below : v > pivot ? above : at).push_back(p);
+    }
+  }
+
+  std::vector<uint32_t> merged(const std::vector<uint32_t> &a,
+                               const std::vector<uint32_t> &b) const {
+    std::vector<uint32_t> out(a.size() + b.size());
+    std::merge(a.begin(), a.end(), b.begin(), b.end(), out.begin(),
+               [this](uint32_t x, uint32_t y) {
+                 return position[x] < position[y];
+               });
+    return out;
+  }
+
+  /* Final ranks for points, given in lexicographic order and equal in the
+   * objectives after k, once every point outside them that could dominate
+   * one has been applied.
+   */
+  void splitA(std::vector<uint32_t> &points, size_t k) {
+    if (points.size() < 2) {
+      return;
+    }
+    if (points.size() <= brute) {
+      for (size_t j = 1; j < points.size(); j++) {
+        for (size_t i = 0; i < j; i++) {
+          if (covers(points[i], points[j], k)) {
+            raise(points[j], points[i]);
+          }
+        }
+      }
+      return;
+    }
+    if (k == 1) {
+      sweep(points, points, true);
+      return;
+    }
+    std::vector<uint32_t> below, at, above;
+    partition(points, k, median(points, k), below, at, above);
+    if (below.empty() && above.empty()) {
+      splitA(points, k - 1);
+      return;
+    }
+    splitA(below, k);
+    splitB(below, at, k - 1);
+    splitA(at, k - 1);
+    splitB(merged(below, at), above, k - 1);
+    splitA(above, k);
+  }
+
+  /* Raises each of high by the finished ranks of low, where every point of
+   * low is no worse than every point of high after objective k.
+   */
+  void splitB(const std::vector<uint32_t> &low,
+              const std::vector<uint32_t> &high, size_t k) {
+    if (low.empty() || high.empty()) {
+      return;
+    }
+    if (low.size() * high.size() <= brute * brute) {
+      for (uint32_t h : high) {
+        for (uint32_t l : low) {
+          if (covers(l, h, k)) {
+            raise(h, l);
+          }
+        }
+      }
+      return;
+    }
+    if (k == 1) {
+      sweep(low, high, false);
+      return;
+    }
+    int64_t low_min = INT64_MAX, low_max = INT64_MIN;
+    int64_t high_min = INT64_MAX, high_max = INT64_MIN;
+    for (uint32_t p : low) {
+      low_min = std::min(low_min, values[p * m + k]);
+      low_max = std::max(low_max, values[p * m + k]);
+    }
+    for (uint32_t p : high) {
+      high_min = std::min(high_min, values[p * m + k]);
+      high_max = std::max(high_max, values[p * m + k]);
+    }
+    if (low_max <= high_min) {
+      splitB(low, high, k - 1);
+      return;
+    }
+    if (low_min > high_max) {
+      return;
+    }
+    std::vector<uint32_t> both = merged(low, high);
+    int64_t pivot = median(both, k);
+    std::vector<uint32_t> low_below, low_at, low_above;
+    std::vector<uint32_t> high_below, high_at, high_above;
+    partition(low, k, pivot, low_below, low_at, low_above);
+    partition(high, k, pivot, high_below, high_at, high_above);
+    splitB(low_below, high_below, k);
+    splitB(merged(low_below, low_at), merged(high_at, high_above), k - 1);
+    splitB(low_above, high_above, k);
+  }
+
+  /* Objectives 0 and 1: in lexicographic order, each point of high takes
+   * one more than the best rank among earlier points of low no worse in
+   * objective 1, kept in a prefix-max Fenwick tree over objective 1. With
+   * low and high the same points this finishes them as it goes.
+   */
+  void sweep(const std::vector<uint32_t> &low,
+             const std::vector<uint32_t> &high, bool same_points) {
+    keys.clear();
+    for (uint32_t p : low) {
+      keys.push_back(values[p * m + 1]);
+    }
+    if (!same_points) {
+      for (uint32_t p : high) {
+        keys.push_back(values[p * m + 1]);
+      }
+    }
+    std::sort(keys.begin(), keys.end());
+    keys.erase(std::unique(keys.begin(), keys.end()), keys.end());
+    tree.assign(keys.size() + 1, -1);
+    auto key = [this](uint32_t p) {
+      return std::lower_bound(keys.begin(), keys.end(), values[p * m + 1]) -
+             keys.begin() + 1;
+    };
+    auto query = [this](size_t i) {
+      int64_t best = -1;
+      for (; i > 0; i -= i & -i) {
+        best = std::max(best, tree[i]);
+      }
+      return best;
+    };
+    auto insert = [this](size_t i, int64_t r) {
+      for (; i < tree.size(); i += i & -i) {
+        tree[i] = std::max(tree[i], r);
+      }
+    };
+    if (same_points) {
+      for (uint32_t p : low) {
+        size_t i = key(p);
+        int64_t best = query(i);
+        if (best >= 0) {
+          rank[p] = std::max<uint32_t>(rank[p], best + 1);
+        }
+        insert(i, rank[p]);
+      }
+      return;
+    }
+    size_t l = 0;
+    for (uint32_t h : high) {
+      for (; l < low.size() && position[low[l]] < position[h]; l++) {
+        insert(key(low[l]), rank[low[l]]);
+      }
+      int64_t best = query(key(h));
+      if (best >= 0) {
+        rank[h] = std::max<uint32_t>(rank[h], best + 1);
+      }
+    }
+  }
+
+  const int64_t *values;
+  size_t m;
+  std::vector<uint32_t> position;
+  std::vector<int64_t> keys;
+  std::vector<int64_t> tree;
+  std::vector<uint32_t> order;
+  std::vector<uint32_t> sorted;
+  std::vector<double> column;
+  std::vector<double> gaps;
+};
+
+/* Persistent worker threads for data-parallel loops. parallelFor() splits
+ * [0, count) into chunks and runs them on the workers and the calling
+ * thread, returning when all are done. Chunks are normally claimed as
+ * threads free up; a deterministic pool hands chunk c to thread c % size()
+ * so every chunk runs on the same thread from call to call.
+ */
+struct WorkerPool {
+  WorkerPool(unsigned int num_threads, bool deterministic)
+      : deterministic(deterministic), num_threads(std::max(1u, num_threads)),
+        stopping(false), round(0), remaining(0) {
+    for (unsigned int t = 1; t < this->num_threads; t++) {
+      workers.emplace_back([this, t]() { work(t); });
+    }
+  }
+  WorkerPool(const WorkerPool &) = delete;
+  WorkerPool &operator=(const WorkerPool &) = delete;
+  ~WorkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      stopping = true;
+    }
+    wake.notify_all();
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+
+  unsigned int size() const { return num_threads; }
+
+  void parallelFor(size_t count, size_t chunk,
+                   const std::function<void(size_t, size_t)> &fn) {
+    if (count == 0) {
+      return;
+    }
+    chunk = std::max<size_t>(1, chunk);
+    if (num_threads == 1 || count <= chunk) {
+      fn(0, count);
+      return;
+    }
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      task = &fn;
+      task_count = count;
+      task_chunk = chunk;
+      num_chunks = (count + chunk - 1) / chunk;
+      next_chunk = 0;
+      remaining = num_threads - 1;
+      round++;
+    }
+    wake.notify_all();
+    runChunks(0);
+    std::unique_lock<std::mutex> lock(mutex);
+    done.wait(lock, [this]() { return remaining == 0; });
+  }
+
+  const bool deterministic;
+
+private:
+  void work(unsigned int thread) {
+    uint64_t seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        wake.wait(lock, [&]() { return stopping || round != seen; });
+        if (stopping) {
+          return;
+        }
+        seen = round;
+      }
+      runChunks(thread);
+      std::lock_guard<std::mutex> lock(mutex);
+      if (--remaining == 0) {
+        done.notify_one();
+      }
+    }
+  }
+
+  void runChunks(unsigned int thread) {
+    if (deterministic) {
+      for (size_t c = thread; c < num_chunks; c += num_threads) {
+        runChunk(c);
+      }
+    } else {
+      for (size_t c = next_chunk++; c < num_chunks; c = next_chunk++) {
+        runChunk(c);
+      }
+    }
+  }
+
+  void runChunk(size_t c) {
+    size_t begin = c * task_chunk;
+    (*task)(begin, std::min(task_count, begin + task_chunk));
+  }
+
+  unsigned int num_threads;
+  std::vector<std::thread> workers;
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::condition_variable done;
+  bool stopping;
+  uint64_t round;
+  unsigned int remaining;
+  const std::function<void(size_t, size_t)> *task;
+  size_t task_count;
+  size_t task_chunk;
+  size_t num_chunks;
+  std::atomic<size_t> next_chunk;
+};
+
+/* Scores of plans already evaluated, keyed by Zobrist hash and shared
+ * without locks between the scoring threads and islands. Open addressing
+ * over a fixed power-of-two table with a short probe; when a probe finds
+ * no room the plan simply goes uncached. A writer claims a slot by CAS on
+ * its key and publishes the score after, so a reader can miss an entry
+ * still being written but never sees a wrong score.
+ */
+struct ScoreCache {
+  std::atomic<uint64_t> hits;
+  std::atomic<uint64_t> misses;
+
+  ScoreCache(size_t capacity)
+      : hits(0), misses(0), mask(roundUp(capacity) - 1), keys(mask + 1),
+        scores(mask + 1), stored(mask + 1, false) {
+    for (auto &score : scores) {
+      score.store(pending, std::memory_order_relaxed);
+    }
+  }
+
+  bool find(uint64_t hash, int &score) {
+    hash = hash ? hash : 1;
+    for (size_t i = 0; i < probe; i++) {
+      size_t slot = (hash + i) & mask;
+      uint64_t key = keys[slot].load(std::memory_order_acquire);
+      if (key == hash) {
+        score = scores[slot].load(std::memory_order_acquire);
+        if (score != pending) {
+          hits.fetch_add(1, std::memory_order_relaxed);
+          return true;
+        }
+        break;
+      }
+      if (key == 0) {
+        break;
+      }
+    }
+    misses.fetch_add(1, std::memory_order_relaxed);
+    return false;
+  }
+
+  void insert(uint64_t hash, int score) { claim(hash, score); }
+
+  // An entry read back from disk, which drain() will not hand out again.
+  void preload(uint64_t hash, int score) {
+    size_t slot = claim(hash, score);
+    if (slot <= mask) {
+      stored[slot] = true;
+    }
+  }
+
+  // Visits the entries not yet preloaded or drained. Not thread-safe.
+  template <typename Visit> void drain(Visit visit) {
+    for (size_t slot = 0; slot <= mask; slot++) {
+      int score = scores[slot].load(std::memory_order_acquire);
+      if (!stored[slot] && score != pending) {
+        visit(keys[slot].load(std::memory_order_relaxed), score);
+        stored[slot] = true;
+      }
+    }
+  }
+
+private:
+  static constexpr size_t probe = 8;
+  static constexpr int pending = INT_MIN;
+
+  // Returns the slot given the score, or one past mask if the probe was full.
+  size_t claim(uint64_t hash, int score) {
+    hash = hash ? hash : 1;
+    for (size_t i = 0; i < probe; i++) {
+      size_t slot = (hash + i) & mask;
+      uint64_t key = 0;
+      if (keys[slot].compare_exchange_strong(key, hash,
+                                             std::memory_order_acq_rel) ||
+          key == hash) {
+        scores[slot].store(score, std::memory_order_release);
+        return slot;
+      }
+    }
+    return mask + 1;
+  }
+
+  static size_t roundUp(size_t n) {
+    size_t size = 1;
+    while (size < n) {
+      size <<= 1;
+    }
+    return size;
+  }
+
+  size_t mask;
+  std::vector<std::atomic<uint64_t>> keys;
+  std::vector<std::atomic<int>> scores;
+  std::vector<bool> stored;
+};
+
+struct ScoreFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t objective_version;
+  uint64_t graph_fingerprint;
+};
+
+struct ScoreRecord {
+  uint64_t hash;
+  int64_t score;
+};
+
+/* Scores kept across runs in an append-only file of (hash, score) records
+ * behind a header naming the graph and objective they were computed for; a
+ * file made for anything else is an error. On opening, the records are
+ * mapped, deduplicated by hash and, if any repeated, written back compacted
+ * for load() to read into a ScoreCache. The cache's new entries are
+ * appended at the end of the run in a single O_APPEND write. Both steps
+ * hold an exclusive flock, so islands running as separate processes can
+ * share one file. An empty path makes a file that holds and saves nothing.
+ */
+struct ScoreFile {
+  static constexpr uint32_t version = 1;
+
+  std::string error;
+
+  ScoreFile(const std::string &path, uint64_t graph_fingerprint,
+            uint32_t objective_version)
+      : path(path), fd(-1) {
+    if (path.empty()) {
+      return;
+    }
+    fd = open(path.c_str(), O_RDWR | O_CREAT | O_APPEND, 0644);
+    if (fd < 0) {
+      error = "could not open " + path;
+      return;
+    }
+    flock(fd, LOCK_EX);
+    readRecords(graph_fingerprint, objective_version);
+    flock(fd, LOCK_UN);
+  }
+  ScoreFile(const ScoreFile &) = delete;
+  ScoreFile &operator=(const ScoreFile &) = delete;
+  ~ScoreFile() {
+    if (fd >= 0) {
+      close(fd);
+    }
+  }
+
+  bool ok() const { return error.empty(); }
+  bool enabled() const { return fd >= 0; }
+  size_t count() const { return records.size(); }
+
+  void load(ScoreCache &cache) {
+    for (auto &record : records) {
+      cache.preload(record.hash, record.score);
+    }
+    records.clear();
+    records.shrink_to_fit();
+  }
+
+  bool save(ScoreCache &cache) {
+    if (fd < 0) {
+      return true;
+    }
+    std::vector<ScoreRecord> added;
+    cache.drain([&added](uint64_t hash, int score) {
+      added.push_back(ScoreRecord{hash, score});
+    });
+    // Locked so a process opening the file never sees a partial append
+    // as a torn record and cuts it short.
+    size_t bytes = added.size() * sizeof(ScoreRecord);
+    flock(fd, LOCK_EX);
+    bool written = write(fd, added.data(), bytes) == ssize_t(bytes);
+    flock(fd, LOCK_UN);
+    return written;
+  }
+
+private:
+  // Reads the records into memory, writing the header first to an empty
+  // file; sets error otherwise. Called with the lock held.
+  void readRecords(uint64_t graph_fingerprint, uint32_t objective_version) {
+    ScoreFileHeader expected;
+    std::memset(&expected, 0, sizeof(expected));
+    std::memcpy(expected.magic, "GENDISTS", sizeof(expected.magic));
+    expected.version = version;
+    expected.objective_version = objective_version;
+    expected.graph_fingerprint = graph_fingerprint;
+
+    struct stat st;
+    ScoreFileHeader header;
+    if (fstat(fd, &st) != 0) {
+      error = "could not read " + path;
+      return;
+    }
+    if (st.st_size == 0) {
+      if (write(fd, &expected, sizeof(expected)) != sizeof(expected)) {
+        error = "could not write " + path;
+      }
+      return;
+    }
+    if (size_t(st.st_size) < sizeof(header) ||
+        pread(fd, &header, sizeof(header), 0) != sizeof(header) ||
+        std::memcmp(header.magic, expected.magic, sizeof(header.magic)) ||
+        header.version != version) {
+      error = path + " is not a score file";
+      return;
+    }
+    if (std::memcmp(&header, &expected, sizeof(header))) {
+      error = path + " holds scores for another graph or objective";
+      return;
+    }
+    // A record torn by a run that died mid-append is dropped.
+    size_t num_records = (st.st_size - sizeof(header)) / sizeof(ScoreRecord);
+    size_t size = sizeof(header) + num_records * sizeof(ScoreRecord);
+    if (num_records) {
+      MappedFile file(path.c_str());
+      if (file.size < size) {
+        error = "could not read " + path;
+        return;
+      }
+      auto begin = reinterpret_cast<const ScoreRecord *>(file.data +
+                                                          sizeof(header));
+      records.assign(begin, begin + num_records);
+    }
+    std::sort(records.begin(), records.end(),
+              [](const ScoreRecord &a, const ScoreRecord &b) {
+                return a.hash < b.hash;
+              });
+    records.erase(std::unique(records.begin(), records.end(),
+                              [](const ScoreRecord &a, const ScoreRecord &b) {
+                                return a.hash == b.hash;
+                              }),
+                  records.end());
+    bool written;
+    if (records.size() == num_records) {
+      written = size_t(st.st_size) == size || ftruncate(fd, size) == 0;
+    } else {
+      // pwrite would append regardless on an O_APPEND descriptor.
+      size_t bytes = records.size() * sizeof(ScoreRecord);
+      written = ftruncate(fd, sizeof(header)) == 0 &&
+                write(fd, records.data(), bytes) == ssize_t(bytes);
+    }
+    if (!written) {
+      error = "could not write " + path;
+    }
+  }
+
+  std::string path;
+  int fd;
+  std::vector<ScoreRecord> records;
+};
+
+struct GeneticAlgorithmConfig {
+  unsigned int population_size;
+  double mutation_rate;
+  double crossover_rate;
+  unsigned int num_threads;
+  bool deterministic;
+  uint64_t seed;
+  uint32_t stream;
+  // Best individuals copied into each generation untouched.
+  unsigned int num_elites;
+  // Keep the best population_size of parents and children together rather
+  // than replacing the parents outright.
+  bool truncation;
+  // Shared by every GeneticAlgorithm given the same config; may be null.
+  ScoreCache *score_cache;
+  // Mutate children that are exact copies of another child once more.
+  bool remove_clones;
+
+  GeneticAlgorithmConfig(unsigned int population_size, double mutation_rate,
+                         double crossover_rate, unsigned int num_threads = 1,
+                         bool deterministic = false, uint64_t seed = 0,
+                         uint32_t stream = 0)
+      : population_size(population_size), mutation_rate(mutation_rate),
+        crossover_rate(crossover_rate), num_threads(num_threads),
+        deterministic(deterministic), seed(seed), stream(stream),
+        num_elites(0), truncation(false), score_cache(nullptr),
+        remove_clones(false) {}
+};
+
+/* The breeding half of a generation, shared by GeneticAlgorithm and Nsga2.
+ * The owner fills each slot of offspring from a parent it picks with
+ * take(); vary() then mutates the first num_mutate slots from `first` and
+ * crosses pairs of shuffled slots from `first` on, and score() hands the
+ * slots whose genes actually changed to the pool. Each slot draws from its
+ * own stream and the shuffle from one past the last, so a seeded run breeds
+ * the same generation whatever the thread count.
+ */
+template <typename Gene, typename MutatorType, typename CrosserType>
+struct Breeder {
+  typedef typename GeneticAlgorithmType<Gene>::Individual Individual;
+  typedef typename GeneticAlgorithmType<Gene>::Population Population;
+
+  Population offspring;
+  std::vector<RandomGenerator> streams;
+  std::vector<char> changed;
+
+  Breeder(const Individual &prototype, const GeneticAlgorithmConfig &config,
+          MutatorType &mutator, CrosserType &crosser, size_t first)
+      : offspring(prototype, config.population_size),
+        streams(config.population_size + 1),
+        changed(config.population_size), mutator(mutator), crosser(crosser),
+        first(first), order(config.population_size - first),
+        origin(config.population_size),
+        pool(config.num_threads, config.deterministic) {
+    std::iota(order.begin(), order.end(), first);
+    dirty.reserve(config.population_size);
+  }
+
+  void reseed(const GeneticAlgorithmConfig &config, uint32_t generation) {
+    for (uint32_t i = 0; i < streams.size(); i++) {
+      streams[i] = RandomGenerator(config.seed, config.stream, i, generation);
+    }
+  }
+
+  void take(size_t slot, const Population &population, size_t parent) {
+    offspring.copy(slot, population, parent);
+    origin[slot] = geneHash(offspring[slot]);
+    changed[slot] = false;
+  }
+
+  void vary(size_t num_mutate, size_t num_crossover) {
+    for (size_t i = first; i < first + num_mutate; i++) {
+      auto child = offspring[i];
+      mutator(child, streams[i]);
+      changed[i] = true;
+    }
+    streams.back().shuffle(order.begin(), order.end());
+    for (size_t i = 0; i + 1 < num_crossover && i + 1 < order.size();
+         i += 2) {
+      auto a = offspring[order[i]];
+      auto b = offspring[order[i + 1]];
+      crosser(a, b, streams[order[i]]);
+      changed[order[i]] = changed[order[i + 1]] = true;
+    }
+  }
+
+  // Of each group of children with the same hash, keeps the lowest slot
+  // and mutates the rest again. Elites are never mutated, even if several
+  // are copies of one plan.
+  void removeClones() {
+    clones.clear();
+    for (size_t i = 0; i < offspring.size(); i++) {
+      clones.emplace_back(geneHash(offspring[i]), i);
+    }
+    std::sort(clones.begin(), clones.end());
+    for (size_t i = 1; i < clones.size(); i++) {
+      if (clones[i].first == clones[i - 1].first && clones[i].first &&
+          clones[i].second >= first) {
+        auto child = offspring[clones[i].second];
+        mutator(child, streams[clones[i].second]);
+        changed[clones[i].second] = true;
+      }
+    }
+  }
+
+  // Calls score(slot) across the pool for every slot the operators changed;
+  // the rest keep the parent's scores their owner copied with them.
+  template <typename Score> void score(Score score) {
+    dirty.clear();
+    for (size_t i = 0; i < offspring.size(); i++) {
+      if (changed[i] && !unchanged(offspring[i], origin[i])) {
+        dirty.push_back(i);
+      }
+    }
+    pool.parallelFor(dirty.size(), dirty.size() / (pool.size() * 4),
+                     [this, &score](size_t begin, size_t end) {
+                       for (size_t i = begin; i < end; i++) {
+                         score(dirty[i]);
+                       }
+                     });
+  }
+
+  // The slots the last score() found changed, in increasing order.
+  const std::vector<size_t> &changedSlots() const { return dirty; }
+
+private:
+  MutatorType &mutator;
+  CrosserType &crosser;
+  size_t first;
+  std::vector<size_t> order;
+  std::vector<uint64_t> origin;
+  std::vector<std::pair<uint64_t, size_t>> clones;
+  std::vector<size_t> dirty;
+  WorkerPool pool;
+};
+
+/* The operators are template parameters so that a GeneticAlgorithm built
+ * over concrete (final) operator types calls them directly and can inline
+ * them into the generation loop. The defaults are the abstract bases, which
+ * gives the type-erased form whose operators are picked at run time.
+ */
+template <typename Gene, typename MutatorType = Mutator<Gene>,
+          typename CrosserType = Crosser<Gene>,
+          typename ObjectiveType = Objective<Gene>,
+          typename SelectorType = Selector>
+struct GeneticAlgorithm {
+  typedef typename GeneticAlgorithmType<Gene>::Individual Individual;
+  typedef typename GeneticAlgorithmType<Gene>::Population Population;
+
+  Population population;
+  std::vector<int> scores;
+  GeneticAlgorithmConfig config;
+  unsigned int num_elites;
+  unsigned int num_mutate;
+  unsigned int num_crossover;
+  uint32_t generation_count;
+  GeneticAlgorithm(const Individual &prototype, GeneticAlgorithmConfig config,
+                   ObjectiveType &objective, CrosserType &crosser,
+                   MutatorType &mutator, SelectorType &selector)
+      : population(prototype, config.population_size),
+        scores(config.population_size, objective(prototype)), config(config),
+        num_elites(std::min(config.num_elites, config.population_size)),
+        generation_count(0), objective(objective), selector(selector),
+        breeder(prototype, config, mutator, crosser, num_elites),
+        offspring_scores(config.population_size) {
+    num_mutate = std::min<unsigned int>(
+        population.size() - num_elites,
+        std::ceil(config.mutation_rate * population.size()));
+    num_crossover = static_cast<unsigned int>(
+        std::ceil(config.crossover_rate * population.size()));
+  }
+
+  /* Breeds the next generation into the back buffer and swaps the two.
+   * The first num_elites slots take the best parents as they are and the
+   * rest are filled with parents picked by the selector; children that
+   * are neither mutated nor crossed, or that the operators left as they
+   * were, keep their parent's score instead of being rescored.
+   */
+  void generation() {
+    generation_count++;
+    breeder.reseed(config, generation_count);
+    if (num_elites) {
+      rank(population.size(), num_elites);
+      for (size_t i = 0; i < num_elites; i++) {
+        breeder.take(i, population, ranking[i]);
+        offspring_scores[i] = scores[ranking[i]];
+      }
+    }
+    selector.prepare(scores);
+    for (size_t i = num_elites; i < population.size(); i++) {
+      size_t parent = selector(scores, breeder.streams[i]);
+      breeder.take(i, population, parent);
+      offspring_scores[i] = scores[parent];
+    }
+    breeder.vary(num_mutate, num_crossover);
+    if (config.remove_clones) {
+      breeder.removeClones();
+    }
+    breeder.score([this](size_t slot) { score(slot); });
+    if (config.truncation) {
+      truncate();
+    }
+    population.swap(breeder.offspring);
+    scores.swap(offspring_scores);
+  }
+
+  // Slots of the k best individuals, best first.
+  void elites(size_t k, std::vector<size_t> &slots) const {
+    k = std::min(k, scores.size());
+    slots.resize(scores.size());
+    std::iota(slots.begin(), slots.end(), 0);
+    std::partial_sort(
+        slots.begin(), slots.begin() + k, slots.end(),
+        [this](size_t a, size_t b) { return scores[a] < scores[b]; });
+    slots.resize(k);
+  }
+
+  void replace(size_t slot, const Population &from, size_t i, int score) {
+    population.copy(slot, from, i);
+    scores[slot] = score;
+  }
+
+private:
+  void score(size_t slot) {
+    ScoreCache *cache = config.score_cache;
+    auto child = breeder.offspring[slot];
+    uint64_t hash = geneHash(child);
+    if (cache && hash && cache->find(hash, offspring_scores[slot])) {
+      return;
+    }
+    offspring_scores[slot] = objective(child);
+    if (cache && hash) {
+      cache->insert(hash, offspring_scores[slot]);
+    }
+  }
+
+  /* Partitions ranking so its first k entries are the k best of the first
+   * n slots of parents followed by children, in no particular order.
+   */
+  void rank(size_t n, size_t k) {
+    ranking.resize(n);
+    std::iota(ranking.begin(), ranking.end(), 0);
+    select(k);
+  }
+
+  // Moves the k best of the entries already in ranking to its front.
+  void select(size_t k) {
+    if (k < ranking.size()) {
+      std::nth_element(
+          ranking.begin(), ranking.begin() + k, ranking.end(),
+          [this](size_t a, size_t b) { return rankScore(a) < rankScore(b); });
+    }
+  }
+
+  int rankScore(size_t i) const {
+    return i < scores.size() ? scores[i] : offspring_scores[i - scores.size()];
+  }
+
+  uint64_t rankHash(size_t i) {
+    return i < scores.size() ? geneHash(population[i])
+                             : geneHash(breeder.offspring[i - scores.size()]);
+  }
+
+  /* Leaves the best of parents and children in the back buffer, moving
+   * only the surviving parents into the slots of children that lost. Only
+   * children the operators changed compete, and a plan already in the pool
+   * only comes back if there are too few distinct ones to fill it; letting
+   * elites and other copies in fills the population with ties of the best.
+   */
+  void truncate() {
+    size_t size = scores.size();
+    ranking.resize(size);
+    std::iota(ranking.begin(), ranking.end(), 0);
+    for (size_t slot : breeder.changedSlots()) {
+      ranking.push_back(size + slot);
+    }
+    std::sort(ranking.begin(), ranking.end(), [this](size_t a, size_t b) {
+      return std::make_pair(rankHash(a), a) < std::make_pair(rankHash(b), b);
+    });
+    repeats.clear();
+    size_t distinct = 0;
+    uint64_t previous = 0;
+    for (size_t r = 0; r < ranking.size(); r++) {
+      uint64_t hash = rankHash(ranking[r]);
+      if (hash && hash == previous) {
+        repeats.push_back(ranking[r]);
+      } else {
+        ranking[distinct++] = ranking[r];
+      }
+      previous = hash;
+    }
+    ranking.resize(distinct);
+    if (distinct < size) {
+      std::nth_element(
+          repeats.begin(), repeats.begin() + (size - distinct), repeats.end(),
+          [this](size_t a, size_t b) { return rankScore(a) < rankScore(b); });
+      ranking.insert(ranking.end(), repeats.begin(),
+                     repeats.begin() + (size - distinct));
+    }
+    select(size);
+    std::vector<char> &kept = breeder.changed;
+    std::fill(kept.begin(), kept.end(), false);
+    for (size_t r = 0; r < size; r++) {
+      if (ranking[r] >= size) {
+        kept[ranking[r] - size] = true;
+      }
+    }
+    size_t slot = 0;
+    for (size_t r = 0; r < size; r++) {
+      if (ranking[r] < size) {
+        while (kept[slot]) {
+          slot++;
+        }
+        breeder.offspring.copy(slot, population, ranking[r]);
+        offspring_scores[slot] = scores[ranking[r]];
+        kept[slot] = true;
+      }
+    }
+  }
+
+  ObjectiveType &objective;
+  SelectorType &selector;
+  Breeder<Gene, MutatorType, CrosserType> breeder;
+  std::vector<int> offspring_scores;
+  std::vector<size_t> ranking;
+  std::vector<size_t> repeats;
+};
+
+/* NSGA-II (Deb et al., "A Fast and Elitist Multiobjective Genetic
+ * Algorithm"). Parents are picked by binary tournament on front, then
+ * crowding distance; children are bred by the same Breeder as in
+ * GeneticAlgorithm;
+ * and the next population is the best population_size of parents and
+ * children together, front by front, with the last front that does not
+ * fit cut by crowding distance.
+ */
+template <typename Gene> struct Nsga2 {
+  typedef typename GeneticAlgorithmType<Gene>::Individual Individual;
+  typedef typename GeneticAlgorithmType<Gene>::Population Population;
+
+  Population population;
+  // size() scores per slot, slot by slot.
+  std::vector<int64_t> values;
+  GeneticAlgorithmConfig config;
+  uint32_t generation_count;
+
+  Nsga2(const Individual &prototype, GeneticAlgorithmConfig config,
+        MultiObjective<Gene> &objective, Crosser<Gene> &crosser,
+        Mutator<Gene> &mutator)
+      : population(prototype, config.population_size),
+        values(config.population_size * objective.size()), config(config),
+        generation_count(0), objective(objective),
+        breeder(prototype, config, mutator, crosser, 0),
+        offspring_values(values.size()), combined(2 * values.size()),
+        rank(config.population_size, 0),
+        crowding(config.population_size, 0) {
+    size_t m = objective.size();
+    objective(prototype, values.data());
+    for (size_t i = 1; i < population.size(); i++) {
+      std::copy(values.begin(), values.begin() + m, values.begin() + i * m);
+    }
+    num_mutate = std::min<unsigned int>(
+        population.size(), std::ceil(config.mutation_rate * population.size()));
+    num_crossover = static_cast<unsigned int>(
+        std::ceil(config.crossover_rate * population.size()));
+  }
+
+  size_t size() const { return objective.size(); }
+
+  void generation() {
+    size_t n = population.size(), m = objective.size();
+    generation_count++;
+    breeder.reseed(config, generation_count);
+    for (size_t i = 0; i < n; i++) {
+      RandomGenerator &rng = breeder.streams[i];
+      size_t a = rng.bounded(n), b = rng.bounded(n);
+      size_t parent = rank[b] < rank[a] ||
+                              (rank[b] == rank[a] && crowding[b] > crowding[a])
+                          ? b
+                          : a;
+      breeder.take(i, population, parent);
+      std::copy(values.begin() + parent * m, values.begin() + parent * m + m,
+                offspring_values.begin() + i * m);
+    }
+    breeder.vary(num_mutate, num_crossover);
+    if (config.remove_clones) {
+      breeder.removeClones();
+    }
+    breeder.score([this, m](size_t slot) {
+      objective(breeder.offspring[slot], &offspring_values[slot * m]);
+    });
+    survive();
+  }
+
+  // Slots of the current first front.
+  void front(std::vector<size_t> &slots) const {
+    slots.clear();
+    for (size_t i = 0; i < rank.size(); i++) {
+      if (rank[i] == 0) {
+        slots.push_back(i);
+      }
+    }
+  }
+
+private:
+  void survive() {
+    size_t n = population.size(), m = objective.size();
+    std::copy(values.begin(), values.end(), combined.begin());
+    std::copy(offspring_values.begin(), offspring_values.end(),
+              combined.begin() + n * m);
+    sorter.sort(combined.data(), 2 * n, m);
+    sorter.crowd(combined.data(), 2 * n, m);
+
+    survivors.clear();
+    for (auto &front : sorter.fronts) {
+      if (survivors.size() + front.size() > n) {
+        size_t need = n - survivors.size();
+        std::nth_element(front.begin(), front.begin() + need, front.end(),
+                         [this](uint32_t a, uint32_t b) {
+                           return sorter.crowding[a] > sorter.crowding[b];
+                         });
+        survivors.insert(survivors.end(), front.begin(), front.begin() + need);
+        break;
+      }
+      survivors.insert(survivors.end(), front.begin(), front.end());
+    }
+
+    // Children that survive stay in their slots; surviving parents move
+    // into the slots of children that did not.
+    std::vector<char> &kept = breeder.changed;
+    std::fill(kept.begin(), kept.end(), false);
+    for (uint32_t s : survivors) {
+      if (s >= n) {
+        kept[s - n] = true;
+        rank[s - n] = sorter.rank[s];
+        crowding[s - n] = sorter.crowding[s];
+      }
+    }
+    size_t slot = 0;
+    for (uint32_t s : survivors) {
+      if (s < n) {
+        while (kept[slot]) {
+          slot++;
+        }
+        breeder.offspring.copy(slot, population, s);
+        std::copy(values.begin() + s * m, values.begin() + s * m + m,
+                  offspring_values.begin() + slot * m);
+        rank[slot] = sorter.rank[s];
+        crowding[slot] = sorter.crowding[s];
+        kept[slot] = true;
+      }
+    }
+    population.swap(breeder.offspring);
+    values.swap(offspring_values);
+  }
+
+  MultiObjective<Gene> &objective;
+  unsigned int num_mutate;
+  unsigned int num_crossover;
+  Breeder<Gene, Mutator<Gene>, Crosser<Gene>> breeder;
+  std::vector<int64_t> offspring_values;
+  std::vector<int64_t> combined;
+  std::vector<uint32_t> rank;
+  std::vector<double> crowding;
+  std::vector<uint32_t> survivors;
+  ParetoSorter sorter;
+};
+
+/* Bounded lock-free queue for exactly one producer and one consumer thread.
+ * Slots are built up front and filled in place: the producer fills back()
+ * and calls push(), the consumer reads front() and calls pop().
+ */
+template <typename T> struct SpscQueue {
+  SpscQueue(size_t capacity, const T &init)
+      : slots(capacity + 1, init), head(0), tail(0) {}
+
+  T *back() {
+    size_t t = tail.load(std::memory_order_relaxed);
+    if ((t + 1) % slots.size() == head.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &slots[t];
+  }
+  void push() {
+    size_t t = tail.load(std::memory_order_relaxed);
+    tail.store((t + 1) % slots.size(), std::memory_order_release);
+  }
+
+  T *front() {
+    size_t h = head.load(std::memory_order_relaxed);
+    if (h == tail.load(std::memory_order_acquire)) {
+      return nullptr;
+    }
+    return &slots[h];
+  }
+  void pop() {
+    size_t h = head.load(std::memory_order_relaxed);
+    head.store((h + 1) % slots.size(), std::memory_order_release);
+  }
+
+private:
+  std::vector<T> slots;
+  alignas(64) std::atomic<size_t> head;
+  alignas(64) std::atomic<size_t> tail;
+};
+
+enum class MigrationTopology { ring, torus, complete };
+
+// Islands that `island` sends migrants to, in increasing order.
+std::vector<unsigned int> migrationNeighbors(unsigned int island,
+                                             unsigned int n,
+                                             MigrationTopology topology) {
+  std::vector<unsigned int> out;
+  if (topology == MigrationTopology::ring) {
+    out.push_back((island + 1) % n);
+  } else if (topology == MigrationTopology::torus) {
+    unsigned int rows = std::sqrt(n);
+    while (n % rows) {
+      rows--;
+    }
+    unsigned int cols = n / rows;
+    unsigned int r = island / cols, c = island % cols;
+    out = {r * cols + (c + 1) % cols, r * cols + (c + cols - 1) % cols,
+           (r + 1) % rows * cols + c, (r + rows - 1) % rows * cols + c};
+  } else {
+    for (unsigned int other = 0; other < n; other++) {
+      out.push_back(other);
+    }
+  }
+  std::sort(out.begin(), out.end());
+  out.erase(std::unique(out.begin(), out.end()), out.end());
+  out.erase(std::remove(out.begin(), out.end(), island), out.end());
+  return out;
+}
+
+struct IslandConfig {
+  unsigned int num_islands;
+  unsigned int migration_interval;
+  unsigned int num_migrants;
+  MigrationTopology topology;
+  bool synchronous;
+
+  IslandConfig(unsigned int num_islands, unsigned int migration_interval,
+               unsigned int num_migrants, MigrationTopology topology,
+               bool synchronous = false)
+      : num_islands(num_islands), migration_interval(migration_interval),
+        num_migrants(num_migrants), topology(topology),
+        synchronous(synchronous) {}
+};
+
+/* Runs one GeneticAlgorithm per thread. Every migration_interval
+ * generations each island sends copies of its num_migrants best individuals
+ * to every neighbor over a queue per directed edge, then takes in whatever
+ * has arrived in place of its worst individuals. Islands never wait on each
+ * other; a migrant that finds its queue full is dropped. A synchronous
+ * model instead has every island wait for exactly its neighbors' migrants
+ * of the same round, which makes seeded runs repeatable.
+ */
+template <typename Gene> struct IslandModel {
+  typedef typename GeneticAlgorithmType<Gene>::Individual Individual;
+  typedef typename GeneticAlgorithmType<Gene>::Population Population;
+
+  struct Migrant {
+    Population individual;
+    int score;
+  };
+
+  IslandModel(const Individual &prototype, GeneticAlgorithmConfig ga_config,
+              IslandConfig config, Objective<Gene> &objective,
+              std::vector<std::unique_ptr<Crosser<Gene>>> crossers,
+              std::vector<std::unique_ptr<Mutator<Gene>>> mutators,
+              std::vector<std::unique_ptr<Selector>> selectors)
+      : config(config), crossers(std::move(crossers)),
+        mutators(std::move(mutators)), selectors(std::move(selectors)) {
+    this->config.num_islands = this->mutators.size();
+    ga_config.num_threads = 1;
+    for (size_t i = 0; i < this->mutators.size(); i++) {
+      ga_config.stream = i;
+      islands.emplace_back(new GeneticAlgorithm<Gene>(
+          prototype, ga_config, objective, *this->crossers[i],
+          *this->mutators[i], *this->selectors[i]));
+    }
+
+    Migrant init = {Population(prototype, 1), 0};
+    for (unsigned int from = 0; from < islands.size(); from++) {
+      for (unsigned int to :
+           migrationNeighbors(from, islands.size(), config.topology)) {
+        edges.push_back(Edge{from, to,
+                             std::unique_ptr<SpscQueue<Migrant>>(
+                                 new SpscQueue<Migrant>(
+                                     2 * config.num_migrants, init))});
+      }
+    }
+  }
+
+  void run(unsigned int generations) {
+    std::vector<std::thread> threads;
+    for (unsigned int i = 0; i < islands.size(); i++) {
+      threads.emplace_back([this, i, generations]() {
+        std::vector<size_t> elites;
+        for (unsigned int g = 1; g <= generations; g++) {
+          islands[i]->generation();
+          if (config.migration_interval && g % config.migration_interval == 0) {
+            migrate(i, elites);
+          }
+        }
+      });
+    }
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // Island and slot of the best individual across all islands.
+  std::pair<size_t, size_t> best() const {
+    std::pair<size_t, size_t> best(0, 0);
+    for (size_t i = 0; i < islands.size(); i++) {
+      auto &scores = islands[i]->scores;
+      size_t slot = std::min_element(scores.begin(), scores.end()) -
+                    scores.begin();
+      if (scores[slot] < islands[best.first]->scores[best.second]) {
+        best = std::make_pair(i, slot);
+      }
+    }
+    return best;
+  }
+
+  GeneticAlgorithm<Gene> &island(size_t i) { return *islands[i]; }
+
+private:
+  struct Edge {
+    unsigned int from;
+    unsigned int to;
+    std::unique_ptr<SpscQueue<Migrant>> queue;
+  };
+
+  void migrate(unsigned int i, std::vector<size_t> &elites) {
+    GeneticAlgorithm<Gene> &ga = *islands[i];
+    ga.elites(config.num_migrants, elites);
+    for (auto &edge : edges) {
+      if (edge.from != i) {
+        continue;
+      }
+      for (size_t slot : elites) {
+        Migrant *migrant = edge.queue->back();
+        while (!migrant && config.synchronous) {
+          std::this_thread::yield();
+          migrant = edge.queue->back();
+        }
+        if (!migrant) {
+          break;
+        }
+        migrant->individual.copy(0, ga.population, slot);
+        migrant->score = ga.scores[slot];
+        edge.queue->push();
+      }
+    }
+    for (auto &edge : edges) {
+      if (edge.to != i) {
+        continue;
+      }
+      for (size_t received = 0;; received++) {
+        Migrant *migrant = edge.queue->front();
+        while (!migrant && config.synchronous && received < elites.size()) {
+          std::this_thread::yield();
+          migrant = edge.queue->front();
+        }
+        if (!migrant || (config.synchronous && received == elites.size())) {
+          break;
+        }
+        size_t worst = std::max_element(ga.scores.begin(), ga.scores.end()) -
+                       ga.scores.begin();
+        ga.replace(worst, migrant->individual, 0, migrant->score);
+        edge.queue->pop();
+      }
+    }
+  }
+
+  IslandConfig config;
+  std::vector<std::unique_ptr<Crosser<Gene>>> crossers;
+  std::vector<std::unique_ptr<Mutator<Gene>>> mutators;
+  std::vector<std::unique_ptr<Selector>> selectors;
+  std::vector<std::unique_ptr<GeneticAlgorithm<Gene>>> islands;
+  std::vector<Edge> edges;
+};
+
+/* Decides whether moving a precinct out of its legislative district would
+ * split what is left of that district. The precinct's same-district
+ * neighbors are first checked for connectivity among themselves; only when
+ * they fall into several local pieces does a bidirectional search through
+ * the district try to join the pieces, giving up (and refusing the move)
+ * after search_limit precincts.
+ */
+template <typename LegIndex> struct ContiguityGuard {
+  ContiguityGuard(const VotingDistrictGraph &graph, uint32_t search_limit)
+      : graph(graph), search_limit(search_limit), stamp(0),
+        marks(graph.num_districts, 0), slots(graph.num_districts, 0) {}
+
+  bool canRemove(const DistrictPlan<LegIndex> &plan,
+                 VotingDistrictIndex vdist) {
+    LegIndex source = plan[vdist];
+    if (plan.totals[source].precincts <= 1) {
+      return false;
+    }
+
+    uint32_t local = nextStamp();
+    ring.clear();
+    for (auto n = graph.neighborsBegin(vdist); n < graph.neighborsEnd(vdist);
+         n++) {
+      if (plan[*n] == source) {
+        marks[*n] = local;
+        slots[*n] = ring.size();
+        ring.push_back(*n);
+      }
+    }
+    if (ring.size() <= 1) {
+      return true;
+    }
+
+    parents.resize(ring.size());
+    std::iota(parents.begin(), parents.end(), 0);
+    uint32_t pieces = ring.size();
+    for (uint32_t i = 0; i < ring.size(); i++) {
+      for (auto n = graph.neighborsBegin(ring[i]);
+           n < graph.neighborsEnd(ring[i]); n++) {
+        if (marks[*n] == local) {
+          uint32_t a = find(i), b = find(slots[*n]);
+          if (a != b) {
+            parents[a] = b;
+            pieces--;
+          }
+        }
+      }
+    }
+    if (pieces == 1) {
+      return true;
+    }
+
+    for (uint32_t i = 1; i < ring.size(); i++) {
+      if (find(i) != find(0) && !connected(plan, vdist, ring[0], ring[i])) {
+        return false;
+      }
+      parents[find(i)] = find(0);
+    }
+    return true;
+  }
+
+private:
+  uint32_t nextStamp() {
+    if (++stamp == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      stamp = 1;
+    }
+    return stamp;
+  }
+
+  uint32_t find(uint32_t i) {
+    while (parents[i] != i) {
+      i = parents[i] = parents[parents[i]];
+    }
+    return i;
+  }
+
+  bool connected(const DistrictPlan<LegIndex> &plan,
+                 VotingDistrictIndex removed, VotingDistrictIndex a,
+                 VotingDistrictIndex b) {
+    LegIndex source = plan[removed];
+    uint32_t side[2] = {nextStamp(), nextStamp()};
+    std::vector<VotingDistrictIndex> *queues[2] = {&queue_a, &queue_b};
+    size_t heads[2] = {0, 0};
+    queue_a.assign(1, a);
+    queue_b.assign(1, b);
+    marks[a] = side[0];
+    marks[b] = side[1];
+
+    for (uint32_t visited = 0; visited < search_limit; visited++) {
+      size_t left_a = queue_a.size() - heads[0];
+      size_t left_b = queue_b.size() - heads[1];
+      if (left_a == 0 || left_b == 0) {
+        return false;
+      }
+      int s = left_a <= left_b ? 0 : 1;
+      VotingDistrictIndex vdist = (*queues[s])[heads[s]++];
+      for (auto n = graph.neighborsBegin(vdist); n < graph.neighborsEnd(vdist);
+           n++) {
+        if (*n == removed || plan[*n] != source || marks[*n] == side[s]) {
+          continue;
+        }
+        if (marks[*n] == side[1 - s]) {
+          return true;
+        }
+        marks[*n] = side[s];
+        queues[s]->push_back(*n);
+      }
+    }
+    return false;
+  }
+
+  const VotingDistrictGraph &graph;
+  uint32_t search_limit;
+  uint32_t stamp;
+  std::vector<uint32_t> marks;
+  std::vector<uint32_t> slots;
+  std::vector<VotingDistrictIndex> ring;
+  std::vector<uint32_t> parents;
+  std::vector<VotingDistrictIndex> queue_a;
+  std::vector<VotingDistrictIndex> queue_b;
+};
+
+template <typename LegIndex>
+struct VotingDistrictMutator final : Mutator<PrecinctGene<LegIndex>> {
+  const VotingDistrictGraph &graph;
+  ContiguityGuard<LegIndex> guard;
+  unsigned int max_attempts;
+
+  VotingDistrictMutator(const VotingDistrictGraph &graph)
+      : graph(graph), guard(graph, 4096), max_attempts(16) {}
+
+  void operator()(DistrictPlan<LegIndex> &indiv, RandomGenerator &rng) {
+    for (unsigned int attempt = 0;
+         attempt < max_attempts && indiv.boundary.size() > 0; attempt++) {
+      auto vdist = indiv.randomBoundary(rng);
+      if (guard.canRemove(indiv, vdist)) {
+        indiv.assign(vdist, indiv.randomNeighborDistrict(vdist, rng));
+        return;
+      }
+    }
+  }
+};
+
+/* ReCom (DeFord, Duchin and Solomon, "Recombination: A Family of Markov
+ * Chains for Redistricting"). A step merges two adjacent districts, draws a
+ * uniform spanning tree of the merged region by Wilson's algorithm and
+ * cuts a tree edge that leaves both sides within `tolerance` of the ideal
+ * district population; the two sides take back the two labels. Scratch
+ * space is sized once for the whole graph and a step touches only the
+ * precincts of the two districts.
+ */
+template <typename LegIndex>
+struct ReComMutator final : Mutator<PrecinctGene<LegIndex>> {
+  const VotingDistrictGraph &graph;
+  double tolerance;
+  unsigned int max_trees;
+
+  ReComMutator(const VotingDistrictGraph &graph, double tolerance = 0.05)
+      : graph(graph), tolerance(tolerance), max_trees(8), stamp(0),
+        marks(graph.num_districts, 0), local(graph.num_districts),
+        population(graph.num_districts) {
+    int64_t total = 0;
+    for (VotingDistrictIndex v = 0; v < graph.num_districts; v++) {
+      population[v] =
+          graph.republicans[v] + graph.democrats[v] + graph.other[v];
+      total += population[v];
+    }
+    ideal = double(total) / std::max<uint32_t>(1, graph.num_leg_districts);
+  }
+
+  void operator()(DistrictPlan<LegIndex> &plan, RandomGenerator &rng) {
+    step(plan, rng);
+  }
+
+  // One ReCom move; false if no balanced cut turned up in max_trees trees.
+  bool step(DistrictPlan<LegIndex> &plan, RandomGenerator &rng) {
+    if (plan.boundary.size() == 0) {
+      return false;
+    }
+    VotingDistrictIndex v = plan.randomBoundary(rng);
+    LegIndex a = plan[v], b = plan.randomNeighborDistrict(v, rng);
+
+    int64_t total = gather(plan, v, a, b);
+    double low = ideal * (1 - tolerance), high = ideal * (1 + tolerance);
+    for (unsigned int t = 0; t < max_trees; t++) {
+      spanningTree(rng);
+      uint32_t cut = balancedCut(total, low, high, rng);
+      if (cut != none) {
+        bool flip = rng() & 1;
+        split(plan, cut, flip ? a : b, flip ? b : a);
+        return true;
+      }
+    }
+    return false;
+  }
+
+private:
+  static constexpr uint32_t none = UINT32_MAX;
+
+  // Collects the precincts of districts a and b connected to v.
+  int64_t gather(const DistrictPlan<LegIndex> &plan, VotingDistrictIndex v,
+                 LegIndex a, LegIndex b) {
+    uint32_t mark = nextStamp();
+    nodes.assign(1, v);
+    marks[v] = mark;
+    int64_t total = 0;
+    for (uint32_t i = 0; i < nodes.size(); i++) {
+      VotingDistrictIndex u = nodes[i];
+      local[u] = i;
+      total += population[u];
+      for (auto n = graph.neighborsBegin(u); n < graph.neighborsEnd(u); n++) {
+        if (marks[*n] != mark && (plan[*n] == a || plan[*n] == b)) {
+          marks[*n] = mark;
+          nodes.push_back(*n);
+        }
+      }
+    }
+    return total;
+  }
+
+  // Wilson's algorithm: loop-erased random walks from each node in turn
+  // until they hit the tree, leaving each node's parent in `parents`.
+  void spanningTree(RandomGenerator &rng) {
+    uint32_t k = nodes.size();
+    in_tree.assign(k, false);
+    parents.resize(k);
+    uint32_t root = rng.bounded(k);
+    in_tree[root] = true;
+    parents[root] = none;
+    for (uint32_t i = 0; i < k; i++) {
+      for (uint32_t u = i; !in_tree[u]; u = parents[u]) {
+        parents[u] = randomNeighbor(u, rng);
+      }
+      for (uint32_t u = i; !in_tree[u]; u = parents[u]) {
+        in_tree[u] = true;
+      }
+    }
+
+    // Children in CSR form and a root-first order over them.
+    offsets.assign(k + 1, 0);
+    for (uint32_t u = 0; u < k; u++) {
+      if (u != root) {
+        offsets[parents[u] + 1]++;
+      }
+    }
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
+    children.resize(k);
+    fill.assign(offsets.begin(), offsets.end() - 1);
+    for (uint32_t u = 0; u < k; u++) {
+      if (u != root) {
+        children[fill[parents[u]]++] = u;
+      }
+    }
+    order.assign(1, root);
+    for (uint32_t i = 0; i < order.size(); i++) {
+      uint32_t u = order[i];
+      order.insert(order.end(), children.begin() + offsets[u],
+                   children.begin() + offsets[u + 1]);
+    }
+  }
+
+  uint32_t randomNeighbor(uint32_t u, RandomGenerator &rng) {
+    VotingDistrictIndex v = nodes[u];
+    uint32_t degree = graph.degree(v);
+    for (;;) {
+      VotingDistrictIndex w = graph.neighborsBegin(v)[rng.bounded(degree)];
+      if (marks[w] == stamp) {
+        return local[w];
+      }
+    }
+  }
+
+  // Sums populations up the tree leaves-first and picks one of the nodes
+  // whose edge to its parent splits the region within [low, high].
+  uint32_t balancedCut(int64_t total, double low, double high,
+                       RandomGenerator &rng) {
+    uint32_t k = nodes.size();
+    subtree.resize(k);
+    for (uint32_t u = 0; u < k; u++) {
+      subtree[u] = population[nodes[u]];
+    }
+    candidates.clear();
+    for (uint32_t i = k; i-- > 1;) {
+      uint32_t u = order[i];
+      subtree[parents[u]] += subtree[u];
+      if (subtree[u] >= low && subtree[u] <= high &&
+          total - subtree[u] >= low && total - subtree[u] <= high) {
+        candidates.push_back(u);
+      }
+    }
+    return candidates.empty() ? none
+                              : candidates[rng.bounded(candidates.size())];
+  }
+
+  // Labels the subtree under `cut` inside and the rest of the region
+  // outside.
+  void split(DistrictPlan<LegIndex> &plan, uint32_t cut, LegIndex inside,
+             LegIndex outside) {
+    side.assign(nodes.size(), false);
+    order.assign(1, cut);
+    side[cut] = true;
+    for (uint32_t i = 0; i < order.size(); i++) {
+      uint32_t u = order[i];
+      for (uint32_t c = offsets[u]; c < offsets[u + 1]; c++) {
+        side[children[c]] = true;
+        order.push_back(children[c]);
+      }
+    }
+    for (uint32_t u = 0; u < nodes.size(); u++) {
+      LegIndex leg = side[u] ? inside : outside;
+      if (plan[nodes[u]] != leg) {
+        plan.assign(nodes[u], leg);
+      }
+    }
+  }
+
+  uint32_t nextStamp() {
+    if (++stamp == 0) {
+      std::fill(marks.begin(), marks.end(), 0);
+      stamp = 1;
+    }
+    return stamp;
+  }
+
+  double ideal;
+  uint32_t stamp;
+  std::vector<uint32_t> marks;
+  std::vector<uint32_t> local;
+  std::vector<int64_t> population;
+  std::vector<VotingDistrictIndex> nodes;
+  std::vector<char> in_tree;
+  std::vector<char> side;
+  std::vector<uint32_t> parents;
+  std::vector<uint32_t> offsets;
+  std::vector<uint32_t> fill;
+  std::vector<uint32_t> children;
+  std::vector<uint32_t> order;
+  std::vector<int64_t> subtree;
+  std::vector<uint32_t> candidates;
+};
+
+template <typename Gene> struct GenericCrosser final : Crosser<Gene> {
+  void operator()(typename GeneticAlgorithmType<Gene>::Individual &a,
+                  typename GeneticAlgorithmType<Gene>::Individual &b,
+                  RandomGenerator &rng) {
+    auto offset = rng.bounded(a.size());
+    swapGenes(a, b, offset, a.size());
+  }
+};
+
+/* Crosses two plans district by district over the adjacency graph. One
+ * child keeps a random half of the districts whole from its first parent
+ * and takes the rest from the second parent wherever they do not overlap,
+ * keeping only the largest connected piece of each; the other child does
+ * the same the other way round. Precincts left over are filled by
+ * breadth-first growth of the districts around them, so children of
+ * contiguous parents are contiguous. A child that would lose a district
+ * is left as its parent.
+ */
+template <typename LegIndex>
+struct RegionCrosser final : Crosser<PrecinctGene<LegIndex>> {
+  const VotingDistrictGraph &graph;
+
+  RegionCrosser(const VotingDistrictGraph &graph)
+      : graph(graph), first(graph.num_districts), second(graph.num_districts),
+        labels(graph.num_districts), pieces(graph.num_districts) {
+    queue.reserve(graph.num_districts);
+  }
+
+  void operator()(DistrictPlan<LegIndex> &a, DistrictPlan<LegIndex> &b,
+                  RandomGenerator &rng) {
+    size_t k = a.numLegDistricts();
+    if (k < 2) {
+      return;
+    }
+    keep.resize(k);
+    for (bool mixed = false; !mixed;) {
+      for (size_t leg = 0; leg < k; leg++) {
+        keep[leg] = rng() & 1;
+        mixed |= keep[leg] != keep[0];
+      }
+    }
+    std::copy(a.begin(), a.end(), first.begin());
+    std::copy(b.begin(), b.end(), second.begin());
+    combine(a, first, second, true, rng);
+    combine(b, second, first, false, rng);
+  }
+
+private:
+  static constexpr uint32_t unassigned = UINT32_MAX;
+
+  void combine(DistrictPlan<LegIndex> &child,
+               const std::vector<LegIndex> &primary,
+               const std::vector<LegIndex> &secondary, char side,
+               RandomGenerator &rng) {
+    uint32_t n = graph.num_districts;
+    size_t k = child.numLegDistricts();
+    for (VotingDistrictIndex v = 0; v < n; v++) {
+      labels[v] = keep[primary[v]] == side     ? primary[v]
+                  : keep[secondary[v]] != side ? secondary[v]
+                                               : unassigned;
+    }
+
+    // Label each piece of the districts taken from secondary, remembering
+    // the largest piece of each district.
+    std::fill(pieces.begin(), pieces.end(), unassigned);
+    largest.assign(k, unassigned);
+    largest_size.assign(k, 0);
+    uint32_t num_pieces = 0;
+    for (VotingDistrictIndex v = 0; v < n; v++) {
+      uint32_t leg = labels[v];
+      if (leg == unassigned || keep[leg] == side || pieces[v] != unassigned) {
+        continue;
+      }
+      queue.assign(1, v);
+      pieces[v] = num_pieces;
+      for (size_t i = 0; i < queue.size(); i++) {
+        VotingDistrictIndex u = queue[i];
+        for (auto w = graph.neighborsBegin(u); w < graph.neighborsEnd(u);
+             w++) {
+          if (labels[*w] == leg && pieces[*w] == unassigned) {
+            pieces[*w] = num_pieces;
+            queue.push_back(*w);
+          }
+        }
+      }
+      if (queue.size() > largest_size[leg]) {
+        largest_size[leg] = queue.size();
+        largest[leg] = num_pieces;
+      }
+      num_pieces++;
+    }
+
+    present.assign(k, false);
+    for (VotingDistrictIndex v = 0; v < n; v++) {
+      uint32_t leg = labels[v];
+      if (leg != unassigned && keep[leg] != side && pieces[v] != largest[leg]) {
+        labels[v] = unassigned;
+      } else if (leg != unassigned) {
+        present[leg] = true;
+      }
+    }
+    if (std::find(present.begin(), present.end(), false) != present.end()) {
+      return;
+    }
+
+    queue.clear();
+    for (VotingDistrictIndex v = 0; v < n; v++) {
+      if (labels[v] == unassigned) {
+        continue;
+      }
+      for (auto w = graph.neighborsBegin(v); w < graph.neighborsEnd(v); w++) {
+        if (labels[*w] == unassigned) {
+          queue.push_back(v);
+          break;
+        }
+      }
+    }
+    rng.shuffle(queue.begin(), queue.end());
+    for (size_t i = 0; i < queue.size(); i++) {
+      VotingDistrictIndex u = queue[i];
+      for (auto w = graph.neighborsBegin(u); w < graph.neighborsEnd(u); w++) {
+        if (labels[*w] == unassigned) {
+          labels[*w] = labels[u];
+          queue.push_back(*w);
+        }
+      }
+    }
+
+    for (VotingDistrictIndex v = 0; v < n; v++) {
+      // Only precincts cut off from every district are still unassigned.
+      LegIndex leg = labels[v] == unassigned ? primary[v] : labels[v];
+      if (child[v] != leg) {
+        child.assign(v, leg);
+      }
+    }
+  }
+
+  std::vector<char> keep;
+  std::vector<LegIndex> first;
+  std::vector<LegIndex> second;
+  std::vector<uint32_t> labels;
+  std::vector<uint32_t> pieces;
+  std::vector<uint32_t> largest;
+  std::vector<size_t> largest_size;
+  std::vector<char> present;
+  std::vector<VotingDistrictIndex> queue;
+};
+
+// Total distance of each legislative district's population from an even
+// split; lower is better.
+template <typename LegIndex>
+struct VotingDistrictObjective final : Objective<PrecinctGene<LegIndex>> {
+  const VotingDistrictGraph &graph;
+  int64_t ideal_population;
+
+  // Bumped whenever a plan's score changes, so saved scores are dropped.
+  static constexpr uint32_t version = 1;
+
+  VotingDistrictObjective(const VotingDistrictGraph &graph)
+      : graph(graph), ideal_population(0) {
+    for (VotingDistrictIndex v = 0; v < graph.num_districts; v++) {
+      ideal_population +=
+          graph.republicans[v] + graph.democrats[v] + graph.other[v];
+    }
+    ideal_population /= std::max<uint32_t>(1, graph.num_leg_districts);
+  }
+
+  int operator()(const DistrictPlan<LegIndex> &indiv) {
+    return static_cast<int>(std::min<int64_t>(deviation(indiv), INT32_MAX));
+  }
+
+  int64_t deviation(const DistrictPlan<LegIndex> &indiv) const {
+    int64_t deviation = 0;
+    for (size_t leg = 0; leg < indiv.numLegDistricts(); leg++) {
+      deviation += std::abs(indiv.totals[leg].population() - ideal_population);
+    }
+    return deviation;
+  }
+
+  // Only the two districts' totals change, so a move is priced in O(1).
+  int64_t delta(DistrictPlan<LegIndex> &indiv, size_t vdist, LegIndex from,
+                LegIndex to) {
+    int64_t people =
+        graph.republicans[vdist] + graph.democrats[vdist] + graph.other[vdist];
+    int64_t source = indiv.totals[from].population() - ideal_population;
+    int64_t target = indiv.totals[to].population() - ideal_population;
+    return std::abs(source - people) + std::abs(target + people) -
+           std::abs(source) - std::abs(target);
+  }
+};
+
+/* The plan scores NSGA-II trades off: total population deviation, the
+ * number of adjacent precinct pairs split between districts (fewer cut
+ * edges means more compact districts), and the efficiency gap between
+ * the two parties' wasted votes in parts per million of votes cast.
+ */
+template <typename LegIndex>
+struct RedistrictingObjectives final
+    : MultiObjective<PrecinctGene<LegIndex>> {
+  const VotingDistrictGraph &graph;
+  VotingDistrictObjective<LegIndex> deviation;
+
+  RedistrictingObjectives(const VotingDistrictGraph &graph)
+      : graph(graph), deviation(graph) {}
+
+  size_t size() const { return 3; }
+
+  const char *name(size_t m) const {
+    static const char *names[] = {"deviation", "cut_edges", "gap_ppm"};
+    return names[m];
+  }
+
+  void operator()(const DistrictPlan<LegIndex> &plan, int64_t *scores) {
+    scores[0] = deviation.deviation(plan);
+
+    int64_t cut = 0;
+    for (VotingDistrictIndex v = 0; v < graph.num_districts; v++) {
+      for (auto n = graph.neighborsBegin(v); n < graph.neighborsEnd(v); n++) {
+        cut += *n > v && plan[*n] != plan[v];
+      }
+    }
+    scores[1] = cut;
+
+    int64_t wasted = 0, votes = 0;
+    for (size_t leg = 0; leg < plan.numLegDistricts(); leg++) {
+      const DistrictTotals &totals = plan.totals[leg];
+      int64_t cast = totals.republicans + totals.democrats;
+      int64_t needed = cast / 2 + 1;
+      int64_t r = totals.republicans >= needed ? totals.republicans - needed
+                                               : totals.republicans;
+      int64_t d = totals.democrats >= needed ? totals.democrats - needed
+                                             : totals.democrats;
+      wasted += r - d;
+      votes += cast;
+    }
+    scores[2] = votes ? std::abs(wasted) * 1000000 / votes : 0;
+  }
+};
+
+struct AnnealingConfig {
+  unsigned int steps;
+  unsigned int num_replicas;
+  unsigned int swap_interval;
+  double t_max;
+  double t_min;
+  unsigned int num_threads;
+  uint64_t seed;
+
+  AnnealingConfig(unsigned int steps, unsigned int num_replicas,
+                  unsigned int swap_interval, double t_max, double t_min,
+                  unsigned int num_threads = 1, uint64_t seed = 0)
+      : steps(steps), num_replicas(std::max(1u, num_replicas)),
+        swap_interval(std::max(1u, swap_interval)), t_max(t_max),
+        t_min(t_min), num_threads(num_threads), seed(seed) {}
+};
+
+/* Metropolis search over single-precinct moves. With one replica the
+ * temperature falls geometrically from t_max to t_min over the run
+ * (simulated annealing). With several, each replica holds one of a fixed
+ * ladder of temperatures spaced geometrically between the two; replicas
+ * run swap_interval steps at a time on the worker pool, then neighbors on
+ * the ladder try to trade temperatures (parallel tempering). Proposals are
+ * priced with Objective::delta, so energies are scores, and only accepted
+ * ones pay for the contiguity check.
+ */
+template <typename LegIndex> struct Annealer {
+  AnnealingConfig config;
+  PlanPopulation<LegIndex> plans;
+  std::vector<int64_t> energy;
+  int64_t best_energy;
+  uint64_t accepted;
+  uint64_t swaps;
+  uint64_t swap_attempts;
+
+  Annealer(const VotingDistrictGraph &graph,
+           Objective<PrecinctGene<LegIndex>> &objective, AnnealingConfig config)
+      : config(config), plans(graph, config.num_replicas + 1),
+        energy(config.num_replicas), accepted(0), swaps(0), swap_attempts(0),
+        graph(graph), objective(objective), ladder(config.num_replicas),
+        rung(config.num_replicas), replica_at(config.num_replicas),
+        moves(config.num_replicas),
+        pool(config.num_threads, false) {
+    unsigned int n = config.num_replicas;
+    for (unsigned int r = 0; r < n; r++) {
+      guards.emplace_back(new ContiguityGuard<LegIndex>(graph, 4096));
+      energy[r] = objective(plans[r]);
+      ladder[r] = temperature(r, n);
+      rung[r] = replica_at[r] = r;
+    }
+    best_energy = energy[0];
+  }
+
+  // The lowest-energy plan seen at the end of any round.
+  DistrictPlan<LegIndex> best() { return plans[config.num_replicas]; }
+
+  void run() {
+    unsigned int n = config.num_replicas;
+    uint32_t rounds = (config.steps + config.swap_interval - 1) /
+                      config.swap_interval;
+    for (uint32_t round = 0; round < rounds; round++) {
+      uint32_t begin = round * config.swap_interval;
+      uint32_t end = std::min(config.steps, begin + config.swap_interval);
+      pool.parallelFor(n, 1, [&](size_t first, size_t last) {
+        for (size_t r = first; r < last; r++) {
+          RandomGenerator rng(config.seed, r, 0, round);
+          for (uint32_t step = begin; step < end; step++) {
+            double t =
+                n > 1 ? ladder[rung[r]] : temperature(step, config.steps);
+            moves[r] += propose(r, t, rng);
+          }
+        }
+      });
+      if (n > 1) {
+        exchange(round);
+      }
+      for (unsigned int r = 0; r < n; r++) {
+        if (energy[r] < best_energy) {
+          best_energy = energy[r];
+          plans.copy(n, plans, r);
+        }
+      }
+    }
+    accepted = std::accumulate(moves.begin(), moves.end(), uint64_t(0));
+  }
+
+private:
+  // Point i of n on the geometric scale from t_max down to t_min.
+  double temperature(uint32_t i, uint32_t n) const {
+    if (n < 2) {
+      return config.t_max;
+    }
+    return config.t_max * std::pow(config.t_min / config.t_max,
+                                   double(i) / (n - 1));
+  }
+
+  bool propose(size_t r, double t, RandomGenerator &rng) {
+    auto plan = plans[r];
+    if (plan.boundary.size() == 0) {
+      return false;
+    }
+    VotingDistrictIndex v = plan.randomBoundary(rng);
+    LegIndex from = plan[v], to = plan.randomNeighborDistrict(v, rng);
+
+    int64_t delta = objective.delta(plan, v, from, to);
+    if (delta > 0 && rng.uniform() >= std::exp(-delta / t)) {
+      return false;
+    }
+    if (!guards[r]->canRemove(plan, v)) {
+      return false;
+    }
+    plan.assign(v, to);
+    objective.commit(plan, v, from, to);
+    energy[r] += delta;
+    return true;
+  }
+
+  // Offers each even (or odd, on odd rounds) pair of neighboring rungs a
+  // swap, accepted with probability min(1, e^((1/t_i - 1/t_j)(E_i - E_j))).
+  void exchange(uint32_t round) {
+    unsigned int n = config.num_replicas;
+    RandomGenerator rng(config.seed, n, 0, round);
+    for (unsigned int i = round % 2; i + 1 < n; i += 2) {
+      unsigned int a = replica_at[i], b = replica_at[i + 1];
+      double log_ratio =
+          (1 / ladder[i] - 1 / ladder[i + 1]) * double(energy[a] - energy[b]);
+      swap_attempts++;
+      if (log_ratio >= 0 || rng.uniform() < std::exp(log_ratio)) {
+        std::swap(replica_at[i], replica_at[i + 1]);
+        rung[a] = i + 1;
+        rung[b] = i;
+        swaps++;
+      }
+    }
+  }
+
+  const VotingDistrictGraph &graph;
+  Objective<PrecinctGene<LegIndex>> &objective;
+  std::vector<std::unique_ptr<ContiguityGuard<LegIndex>>> guards;
+  std::vector<double> ladder;
+  std::vector<unsigned int> rung;
+  std::vector<unsigned int> replica_at;
+  std::vector<uint64_t> moves;
+  WorkerPool pool;
+};
+
+int loadVotingDistrictGraph(VotingDistrictGraph &graph) {
+  std::vector<VotingDistrict> records;
+  ParseError error;
+  if (!loadVotingDistricts("voting_districts.tsv", records, error)) {
+    if (!error.line_num) {
+      std::cerr << "District File: could not open voting_districts.tsv"
+                << std::endl;
+      return -2;
+    }
+    std::cerr << "District File: Line " << error.line_num << " is invalid"
+              << std::endl
+              << error.line << std::endl;
+    return -2;
+  }
+
+  std::vector<std::pair<int, int>> edges;
+  if (!loadVotingDistrictNeighbors("voting_district_neigbors.tsv", edges,
+                                   error)) {
+    if (!error.line_num) {
+      std::cerr << "Neighbor File: could not open voting_district_neigbors.tsv"
+                << std::endl;
+      return -3;
+    }
+    std::cerr << "Neighbor File: Line " << error.line_num << " is invalid"
+              << std::endl
+              << error.line << std::endl;
+    return -3;
+  }
+
+  int line_num = graph.build(records, edges);
+  if (line_num > 0) {
+    std::cerr << "District File: Line " << line_num
+              << " repeats voting district "
+              << records[line_num - 1].voting_district_id.id << std::endl;
+    return -2;
+  }
+  if (line_num < 0) {
+    std::cerr << "Neighbor File: Line " << -line_num
+              << " names an unknown voting district" << std::endl
+              << edges[-line_num - 1].first << "\t"
+              << edges[-line_num - 1].second << std::endl;
+    return -3;
+  }
+  return 0;
+}
+
+// Compares modification times to the nanosecond, so a file edited in the
+// same second as it was compiled still counts as newer.
+bool newerThan(const char *path, const char *other) {
+  struct stat a, b;
+  return stat(path, &a) == 0 &&
+         (stat(other, &b) != 0 ||
+          std::make_pair(a.st_mtim.tv_sec, a.st_mtim.tv_nsec) >=
+              std::make_pair(b.st_mtim.tv_sec, b.st_mtim.tv_nsec));
+}
+
+struct SharedIslandHeader {
+  char magic[8];
+  std::atomic<uint32_t> ready;
+  uint32_t version;
+  uint32_t num_islands;
+  uint32_t topology;
+  uint32_t num_districts;
+  uint32_t gene_size;
+  uint32_t capacity;
+  uint64_t graph_fingerprint;
+  uint64_t run_id;
+};
+
+struct SharedIslandStatus {
+  std::atomic<uint64_t> sequence;
+  std::atomic<uint32_t> state;
+  std::atomic<uint32_t> completed;
+  int32_t score;
+  uint32_t generation;
+};
+
+struct SharedRing {
+  alignas(64) std::atomic<uint64_t> head;
+  alignas(64) std::atomic<uint64_t> tail;
+};
+
+/* POSIX shared memory for islands running as separate processes. The
+ * segment holds a header, then a status block per island with its state,
+ * last completed generation and the best plan it has published, then one
+ * single-producer ring of migrant plans per directed migration edge.
+ * Everything is found from offsets computed from the header, so processes
+ * can attach in any order, and an island that is restarted resumes its
+ * rings where they stood. A segment left by another run id, or by a run
+ * whose islands all finished, is cleared by the first process to attach.
+ */
+struct SharedIslandSegment {
+  enum State { idle = 0, running = 1, finished = 2 };
+
+  std::vector<std::pair<unsigned int, unsigned int>> edges;
+  std::string error;
+
+  SharedIslandSegment(const std::string &name, uint32_t num_islands,
+                      MigrationTopology topology, uint32_t num_districts,
+                      uint32_t gene_size, uint32_t capacity,
+                      uint64_t graph_fingerprint, uint64_t run_id)
+      : name(name), base(nullptr), size(0) {
+    for (unsigned int from = 0; from < num_islands; from++) {
+      for (unsigned int to :
+           migrationNeighbors(from, num_islands, topology)) {
+        edges.emplace_back(from, to);
+      }
+    }
+    gene_bytes = size_t(num_districts) * gene_size;
+    slot_size = round(sizeof(int64_t) + gene_bytes, 8);
+    status_offset = round(sizeof(SharedIslandHeader), 64);
+    status_stride = round(sizeof(SharedIslandStatus) + gene_bytes, 64);
+    ring_offset = status_offset + num_islands * status_stride;
+    ring_stride = round(sizeof(SharedRing) + capacity * slot_size, 64);
+    size = ring_offset + edges.size() * ring_stride;
+    this->capacity = capacity;
+
+    bool created = true;
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+    if (fd < 0 && errno == EEXIST) {
+      created = false;
+      fd = shm_open(name.c_str(), O_RDWR, 0600);
+    }
+    if (fd < 0) {
+      error = "could not open " + name;
+      return;
+    }
+    if (created && ftruncate(fd, size) != 0) {
+      close(fd);
+      error = "could not size " + name;
+      return;
+    }
+    struct stat st;
+    for (int wait = 0; fstat(fd, &st) == 0 && size_t(st.st_size) < size &&
+                       wait < 100;
+         wait++) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (size_t(st.st_size) != size) {
+      close(fd);
+      error = name + " was created for a different run";
+      return;
+    }
+    void *addr = mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      error = "could not map " + name;
+      return;
+    }
+    base = static_cast<char *>(addr);
+
+    SharedIslandHeader expected;
+    std::memcpy(expected.magic, "GENDISTI", sizeof(expected.magic));
+    expected.version = 2;
+    expected.num_islands = num_islands;
+    expected.topology = static_cast<uint32_t>(topology);
+    expected.num_districts = num_districts;
+    expected.gene_size = gene_size;
+    expected.capacity = capacity;
+    expected.graph_fingerprint = graph_fingerprint;
+
+    if (created) {
+      auto header = new (base) SharedIslandHeader();
+      std::memcpy(header->magic, expected.magic, sizeof(header->magic));
+      header->version = expected.version;
+      header->num_islands = num_islands;
+      header->topology = expected.topology;
+      header->num_districts = num_districts;
+      header->gene_size = gene_size;
+      header->capacity = capacity;
+      header->graph_fingerprint = graph_fingerprint;
+      clear(run_id);
+      header->ready.store(1, std::memory_order_release);
+      return;
+    }
+
+    // ready doubles as a lock around checking and clearing the run.
+    auto header = reinterpret_cast<SharedIslandHeader *>(base);
+    for (int wait = 0;; wait++) {
+      uint32_t ready = 1;
+      if (header->ready.compare_exchange_weak(ready, 0,
+                                              std::memory_order_acquire)) {
+        break;
+      }
+      if (wait == 100) {
+        error = name + " was never initialized";
+        return;
+      }
+      std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    }
+    if (std::memcmp(header->magic, expected.magic, sizeof(header->magic)) ||
+        header->version != expected.version ||
+        header->num_islands != num_islands ||
+        header->topology != expected.topology ||
+        header->num_districts != num_districts ||
+        header->gene_size != gene_size || header->capacity != capacity ||
+        header->graph_fingerprint != graph_fingerprint) {
+      error = name + " was created for a different run";
+    } else if (header->run_id != run_id || allFinished(num_islands)) {
+      clear(run_id);
+    }
+    header->ready.store(1, std::memory_order_release);
+  }
+  SharedIslandSegment(const SharedIslandSegment &) = delete;
+  SharedIslandSegment &operator=(const SharedIslandSegment &) = delete;
+  ~SharedIslandSegment() {
+    if (base) {
+      munmap(base, size);
+    }
+  }
+
+  bool ok() const { return base && error.empty(); }
+  void unlink() { shm_unlink(name.c_str()); }
+
+  SharedIslandStatus *status(unsigned int island) {
+    return reinterpret_cast<SharedIslandStatus *>(base + status_offset +
+                                                  island * status_stride);
+  }
+
+  void setState(unsigned int island, State state) {
+    status(island)->state.store(state, std::memory_order_release);
+  }
+  State state(unsigned int island) {
+    return State(status(island)->state.load(std::memory_order_acquire));
+  }
+
+  // The last generation an island finished, where a restart picks up.
+  void complete(unsigned int island, uint32_t generation) {
+    status(island)->completed.store(generation, std::memory_order_release);
+  }
+  uint32_t completed(unsigned int island) {
+    return status(island)->completed.load(std::memory_order_acquire);
+  }
+
+  // Publishes an island's best plan under a sequence lock.
+  void publish(unsigned int island, int score, uint32_t generation,
+               const void *genes) {
+    SharedIslandStatus *s = status(island);
+    uint64_t sequence = s->sequence.load(std::memory_order_relaxed);
+    s->sequence.store(sequence + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    s->score = score;
+    s->generation = generation;
+    std::memcpy(statusGenes(island), genes, gene_bytes);
+    s->sequence.store(sequence + 2, std::memory_order_release);
+  }
+
+  // Copies out an island's best plan; false if it has none or if a writer
+  // that died mid-publish left it torn.
+  bool snapshot(unsigned int island, int &score, uint32_t &generation,
+                void *genes) {
+    SharedIslandStatus *s = status(island);
+    for (int attempt = 0; attempt < 1000; attempt++) {
+      uint64_t before = s->sequence.load(std::memory_order_acquire);
+      if (before & 1) {
+        std::this_thread::yield();
+        continue;
+      }
+      score = s->score;
+      generation = s->generation;
+      std::memcpy(genes, statusGenes(island), gene_bytes);
+      std::atomic_thread_fence(std::memory_order_acquire);
+      if (s->sequence.load(std::memory_order_relaxed) == before) {
+        return before != 0;
+      }
+    }
+    return false;
+  }
+
+  // Run by an island on start: a sequence left odd by a crash means the genes
+  // are torn, so the slot goes back to empty and snapshot() returns false.
+  void recover(unsigned int island) {
+    SharedIslandStatus *s = status(island);
+    uint64_t sequence = s->sequence.load(std::memory_order_relaxed);
+    if (sequence & 1) {
+      s->score = INT_MAX;
+      s->generation = 0;
+      s->sequence.store(0, std::memory_order_release);
+    }
+  }
+
+  bool send(size_t edge, int score, const void *genes) {
+    SharedRing *r = ring(edge);
+    uint64_t tail = r->tail.load(std::memory_order_relaxed);
+    if (tail - r->head.load(std::memory_order_acquire) >= capacity) {
+      return false;
+    }
+    char *slot = ringSlot(edge, tail);
+    int64_t stored = score;
+    std::memcpy(slot, &stored, sizeof(stored));
+    std::memcpy(slot + sizeof(stored), genes, gene_bytes);
+    r->tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  bool receive(size_t edge, int &score, void *genes) {
+    SharedRing *r = ring(edge);
+    uint64_t head = r->head.load(std::memory_order_relaxed);
+    if (head == r->tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    const char *slot = ringSlot(edge, head);
+    int64_t stored;
+    std::memcpy(&stored, slot, sizeof(stored));
+    score = stored;
+    std::memcpy(genes, slot + sizeof(stored), gene_bytes);
+    r->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+private:
+  static size_t round(size_t n, size_t to) { return (n + to - 1) / to * to; }
+
+  void clear(uint64_t run_id) {
+    auto header = reinterpret_cast<SharedIslandHeader *>(base);
+    header->run_id = run_id;
+    for (unsigned int i = 0; i < header->num_islands; i++) {
+      new (status(i)) SharedIslandStatus();
+    }
+    for (size_t e = 0; e < edges.size(); e++) {
+      new (ring(e)) SharedRing();
+    }
+  }
+
+  bool allFinished(unsigned int num_islands) {
+    for (unsigned int i = 0; i < num_islands; i++) {
+      if (state(i) != finished) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  char *statusGenes(unsigned int island) {
+    return reinterpret_cast<char *>(status(island)) +
+           round(sizeof(SharedIslandStatus), 8);
+  }
+  SharedRing *ring(size_t edge) {
+    return reinterpret_cast<SharedRing *>(base + ring_offset +
+                                          edge * ring_stride);
+  }
+  char *ringSlot(size_t edge, uint64_t i) {
+    return reinterpret_cast<char *>(ring(edge)) + sizeof(SharedRing) +
+           (i % capacity) * slot_size;
+  }
+
+  std::string name;
+  char *base;
+  size_t size;
+  size_t gene_bytes;
+  size_t slot_size;
+  size_t status_offset;
+  size_t status_stride;
+  size_t ring_offset;
+  size_t ring_stride;
+  uint32_t capacity;
+};
+
+struct RunOptions {
+  unsigned int generations;
+  unsigned int population_size;
+  unsigned int num_threads;
+  unsigned int num_islands;
+  unsigned int migration_interval;
+  unsigned int num_migrants;
+  MigrationTopology topology;
+  std::string shm_name;
+  uint64_t run_id;
+  unsigned int island;
+  std::string output;
+  std::string graph_path;
+  std::string score_file;
+  uint64_t seed;
+  bool seeded;
+  std::string selection;
+  unsigned int tournament_size;
+  unsigned int num_elites;
+  bool truncation;
+  std::string crossover;
+  std::string mutation;
+  double tolerance;
+  unsigned int steps;
+  unsigned int num_replicas;
+  unsigned int swap_interval;
+  double t_max;
+  double t_min;
+  unsigned int cache_size;
+  bool remove_clones;
+  bool deterministic;
+
+  RunOptions()
+      : generations(100), population_size(10),
+        num_threads(std::thread::hardware_concurrency()), num_islands(1),
+        migration_interval(10), num_migrants(2),
+        topology(MigrationTopology::ring), shm_name("/gendist"), run_id(0),
+        island(0), graph_path("voting_districts.bin"), seeded(false),
+        selection("tournament"), tournament_size(2), num_elites(1),
+        truncation(false), crossover("region"), mutation("flip"),
+        tolerance(0.05), steps(1000), num_replicas(1), swap_interval(100),
+        t_max(0), t_min(0), cache_size(1 << 16), remove_clones(false),
+        deterministic(false) {
+    std::random_device rd;
+    seed = uint64_t(rd()) << 32 | rd();
+  }
+
+  // Reads "--name value" pairs; returns false on anything it does not know.
+  bool parse(int argc, char **argv) {
+    for (int i = 0; i + 1 < argc; i += 2) {
+      std::string name = argv[i];
+      std::string value = argv[i + 1];
+      if (name == "--topology") {
+        if (value == "ring") {
+          topology = MigrationTopology::ring;
+        } else if (value == "torus") {
+          topology = MigrationTopology::torus;
+        } else if (value == "complete") {
+          topology = MigrationTopology::complete;
+        } else {
+          return false;
+        }
+        continue;
+      }
+      if (name == "--shm") {
+        shm_name = value;
+        continue;
+      }
+      if (name == "--output") {
+        output = value;
+        continue;
+      }
+      if (name == "--graph") {
+        graph_path = value;
+        continue;
+      }
+      if (name == "--score-file") {
+        score_file = value;
+        continue;
+      }
+      if (name == "--selection") {
+        selection = value;
+        if (value != "tournament" && value != "rank" &&
+            value != "proportional") {
+          return false;
+        }
+        continue;
+      }
+      if (name == "--crossover") {
+        crossover = value;
+        if (value != "region" && value != "one-point") {
+          return false;
+        }
+        continue;
+      }
+      if (name == "--mutation") {
+        mutation = value;
+        if (value != "flip" && value != "recom") {
+          return false;
+        }
+        continue;
+      }
+      if (name == "--tolerance") {
+        tolerance = std::strtod(value.c_str(), nullptr);
+        continue;
+      }
+      if (name == "--t-max" || name == "--t-min") {
+        (name == "--t-max" ? t_max : t_min) =
+            std::strtod(value.c_str(), nullptr);
+        continue;
+      }
+      if (name == "--schedule") {
+        deterministic = value == "static";
+        if (!deterministic && value != "dynamic") {
+          return false;
+        }
+        continue;
+      }
+      if (name == "--clones") {
+        remove_clones = value == "remove";
+        if (!remove_clones && value != "keep") {
+          return false;
+        }
+        continue;
+      }
+      if (name == "--replacement") {
+        truncation = value == "truncation";
+        if (!truncation && value != "generational") {
+          return false;
+        }
+        continue;
+      }
+      if (name == "--run") {
+        run_id = std::strtoull(value.c_str(), nullptr, 10);
+        continue;
+      }
+      if (name == "--seed") {
+        seed = std::strtoull(value.c_str(), nullptr, 10);
+        seeded = true;
+        continue;
+      }
+      unsigned int number = std::strtoul(value.c_str(), nullptr, 10);
+      if (name == "--generations") {
+        generations = number;
+      } else if (name == "--population") {
+        population_size = std::max(2u, number);
+      } else if (name == "--threads") {
+        num_threads = std::max(1u, number);
+      } else if (name == "--islands") {
+        num_islands = std::max(1u, number);
+      } else if (name == "--migration-interval") {
+        migration_interval = number;
+      } else if (name == "--migrants") {
+        num_migrants = number;
+      } else if (name == "--island") {
+        island = number;
+      } else if (name == "--tournament") {
+        tournament_size = std::max(1u, number);
+      } else if (name == "--elites") {
+        num_elites = number;
+      } else if (name == "--steps") {
+        steps = number;
+      } else if (name == "--replicas") {
+        num_replicas = std::max(1u, number);
+      } else if (name == "--swap-interval") {
+        swap_interval = std::max(1u, number);
+      } else if (name == "--cache") {
+        cache_size = number;
+      } else {
+        return false;
+      }
+    }
+    return argc % 2 == 0;
+  }
+
+  std::unique_ptr<Selector> selector() const {
+    if (selection == "rank") {
+      return std::unique_ptr<Selector>(new RankSelector());
+    }
+    if (selection == "proportional") {
+      return std::unique_ptr<Selector>(new ProportionalSelector());
+    }
+    return std::unique_ptr<Selector>(new TournamentSelector(tournament_size));
+  }
+
+  GeneticAlgorithmConfig gaConfig(ScoreCache *cache,
+                                  uint32_t stream = 0) const {
+    GeneticAlgorithmConfig config(population_size, 0.1, 0.5, num_threads,
+                                  deterministic, seed, stream);
+    config.num_elites = num_elites;
+    config.truncation = truncation;
+    config.score_cache = cache;
+    config.remove_clones = remove_clones;
+    return config;
+  }
+
+  // Scores persist only in a file named by --score-file, and not at all
+  // with --cache 0.
+  std::string scorePath() const { return cache_size ? score_file : ""; }
+
+  // Holds at least everything in file, which is read into it.
+  std::unique_ptr<ScoreCache> scoreCache(ScoreFile &file) const {
+    size_t capacity = std::max<size_t>(cache_size, 2 * file.count());
+    std::unique_ptr<ScoreCache> cache(capacity ? new ScoreCache(capacity)
+                                               : nullptr);
+    if (cache) {
+      file.load(*cache);
+    }
+    return cache;
+  }
+};
+
+template <typename LegIndex>
+std::unique_ptr<Crosser<PrecinctGene<LegIndex>>>
+newCrosser(const VotingDistrictGraph &graph, const RunOptions &options) {
+  typedef Crosser<PrecinctGene<LegIndex>> Base;
+  if (options.crossover == "one-point") {
+    return std::unique_ptr<Base>(new GenericCrosser<PrecinctGene<LegIndex>>());
+  }
+  return std::unique_ptr<Base>(new RegionCrosser<LegIndex>(graph));
+}
+
+template <typename LegIndex>
+std::unique_ptr<Mutator<PrecinctGene<LegIndex>>>
+newMutator(const VotingDistrictGraph &graph, const RunOptions &options) {
+  typedef Mutator<PrecinctGene<LegIndex>> Base;
+  if (options.mutation == "recom") {
+    return std::unique_ptr<Base>(
+        new ReComMutator<LegIndex>(graph, options.tolerance));
+  }
+  return std::unique_ptr<Base>(new VotingDistrictMutator<LegIndex>(graph));
+}
+
+template <typename GA> int evolve(GA &ga, unsigned int generations) {
+  for (unsigned int g = 0; g < generations; g++) {
+    ga.generation();
+  }
+  return *std::min_element(ga.scores.begin(), ga.scores.end());
+}
+
+template <typename LegIndex>
+int optimize(const VotingDistrictGraph &graph, const RunOptions &options) {
+  typedef PrecinctGene<LegIndex> Gene;
+  VotingDistrictObjective<LegIndex> objective(graph);
+  PlanPopulation<LegIndex> initial(graph, 1);
+  ScoreFile scores(options.scorePath(), graph.fingerprint(),
+                   objective.version);
+  if (!scores.ok()) {
+    std::cerr << "Score File: " << scores.error << std::endl;
+    return -4;
+  }
+  auto cache = options.scoreCache(scores);
+  GeneticAlgorithmConfig config = options.gaConfig(cache.get());
+
+  std::cout << "seed " << options.seed << std::endl;
+  int best;
+  if (options.num_islands > 1) {
+    std::vector<std::unique_ptr<Crosser<Gene>>> crossers;
+    std::vector<std::unique_ptr<Mutator<Gene>>> mutators;
+    std::vector<std::unique_ptr<Selector>> selectors;
+    for (unsigned int i = 0; i < options.num_islands; i++) {
+      crossers.push_back(newCrosser<LegIndex>(graph, options));
+      mutators.push_back(newMutator<LegIndex>(graph, options));
+      selectors.push_back(options.selector());
+    }
+    IslandModel<Gene> islands(
+        initial[0], config,
+        IslandConfig(options.num_islands, options.migration_interval,
+                     options.num_migrants, options.topology, options.seeded),
+        objective, std::move(crossers), std::move(mutators),
+        std::move(selectors));
+    islands.run(options.generations);
+    auto slot = islands.best();
+    best = islands.island(slot.first).scores[slot.second];
+  } else if (options.crossover == "region" && options.mutation == "flip" &&
+             options.selection == "tournament") {
+    // The default operators, bound at compile time.
+    RegionCrosser<LegIndex> crosser(graph);
+    VotingDistrictMutator<LegIndex> mutator(graph);
+    TournamentSelector selector(options.tournament_size);
+    GeneticAlgorithm<Gene, VotingDistrictMutator<LegIndex>,
+                     RegionCrosser<LegIndex>, VotingDistrictObjective<LegIndex>,
+                     TournamentSelector>
+        ga(initial[0], config, objective, crosser, mutator, selector);
+    best = evolve(ga, options.generations);
+  } else {
+    auto crosser = newCrosser<LegIndex>(graph, options);
+    auto mutator = newMutator<LegIndex>(graph, options);
+    auto selector = options.selector();
+    GeneticAlgorithm<Gene> ga(initial[0], config, objective, *crosser,
+                              *mutator, *selector);
+    best = evolve(ga, options.generations);
+  }
+  if (cache) {
+    std::cout << "cache hits " << cache->hits << " of "
+              << cache->hits + cache->misses << std::endl;
+  }
+  std::cout << "best score " << best << std::endl;
+  if (cache && !scores.save(*cache)) {
+    std::cerr << "Score File: could not write " << options.score_file
+              << std::endl;
+    return -4;
+  }
+  return 0;
+}
+
+template <typename LegIndex>
+bool writePlan(const std::string &path, const VotingDistrictGraph &graph,
+               const LegIndex *assignment) {
+  std::ofstream out(path);
+  for (VotingDistrictIndex v = 0; v < graph.num_districts; v++) {
+    out << graph.voting_district_ids[v] << "\t"
+        << graph.leg_district_ids[assignment[v]] << "\n";
+  }
+  out.close();
+  return bool(out);
+}
+
+/* Runs the ReCom chain from the plan in the district file, step i drawing
+ * from stream i, and reports how many steps moved and where it ended.
+ */
+template <typename LegIndex>
+int runChain(const VotingDistrictGraph &graph, const RunOptions &options) {
+  PlanPopulation<LegIndex> plans(graph, 1);
+  auto plan = plans[0];
+  ReComMutator<LegIndex> recom(graph, options.tolerance);
+  VotingDistrictObjective<LegIndex> objective(graph);
+  std::cout << "seed " << options.seed << std::endl;
+  unsigned int accepted = 0;
+  for (uint32_t step = 0; step < options.steps; step++) {
+    RandomGenerator rng(options.seed, 0, 0, step);
+    accepted += recom.step(plan, rng);
+  }
+  std::cout << "accepted " << accepted << " of " << options.steps << " steps"
+            << std::endl
+            << "score " << objective(plan) << std::endl;
+  if (!options.output.empty() &&
+      !writePlan(options.output, graph, plan.begin())) {
+    std::cerr << "Plan File: could not write " << options.output << std::endl;
+    return -4;
+  }
+  return 0;
+}
+
+/* Anneals (or, with several replicas, tempers) the plan in the district
+ * file. Unless given, t_max is the mean precinct population, so a move
+ * worth one average precinct of deviation is taken about a third of the
+ * time at the start, and t_min is a thousandth of t_max.
+ */
+template <typename LegIndex>
+int runAnnealer(const VotingDistrictGraph &graph, const RunOptions &options) {
+  VotingDistrictObjective<LegIndex> objective(graph);
+  double t_max = options.t_max;
+  if (t_max <= 0) {
+    t_max = double(objective.ideal_population) *
+            std::max<uint32_t>(1, graph.num_leg_districts) /
+            std::max<uint32_t>(1, graph.num_districts);
+  }
+  double t_min = options.t_min > 0 ? options.t_min : t_max / 1000;
+  Annealer<LegIndex> annealer(
+      graph, objective,
+      AnnealingConfig(options.steps, options.num_replicas,
+                      options.swap_interval, std::max(t_max, 1e-9),
+                      std::min(t_min, t_max), options.num_threads,
+                      options.seed));
+  std::cout << "seed " << options.seed << std::endl;
+  annealer.run();
+  std::cout << "accepted " << annealer.accepted << " of "
+            << uint64_t(options.steps) * options.num_replicas << " moves"
+            << std::endl;
+  if (options.num_replicas > 1) {
+    std::cout << "swapped " << annealer.swaps << " of "
+              << annealer.swap_attempts << std::endl;
+  }
+  auto best = annealer.best();
+  std::cout << "best score " << objective(best) << std::endl;
+  if (!options.output.empty() &&
+      !writePlan(options.output, graph, best.begin())) {
+    std::cerr << "Plan File: could not write " << options.output << std::endl;
+    return -4;
+  }
+  return 0;
+}
+
+/* Evolves a Pareto front with NSGA-II and prints its distinct score
+ * vectors, best deviation first. With --output, the plan behind each row
+ * is written to <output>-<row>.tsv.
+ */
+template <typename LegIndex>
+int runPareto(const VotingDistrictGraph &graph, const RunOptions &options) {
+  typedef PrecinctGene<LegIndex> Gene;
+  RedistrictingObjectives<LegIndex> objectives(graph);
+  auto crosser = newCrosser<LegIndex>(graph, options);
+  auto mutator = newMutator<LegIndex>(graph, options);
+  PlanPopulation<LegIndex> initial(graph, 1);
+  Nsga2<Gene> nsga(initial[0], options.gaConfig(nullptr), objectives,
+                   *crosser, *mutator);
+  std::cout << "seed " << options.seed << std::endl;
+  for (unsigned int g = 0; g < options.generations; g++) {
+    nsga.generation();
+  }
+
+  size_t m = objectives.size();
+  const int64_t *values = nsga.values.data();
+  std::vector<size_t> front;
+  nsga.front(front);
+  std::sort(front.begin(), front.end(), [values, m](size_t a, size_t b) {
+    return std::lexicographical_compare(values + a * m, values + a * m + m,
+                                        values + b * m, values + b * m + m);
+  });
+  front.erase(std::unique(front.begin(), front.end(),
+                          [values, m](size_t a, size_t b) {
+                            return std::equal(values + a * m,
+                                              values + a * m + m,
+                                              values + b * m);
+                          }),
+              front.end());
+
+  std::cout << std::setw(4) << "row";
+  for (size_t k = 0; k < m; k++) {
+    std::cout << std::setw(12) << objectives.name(k);
+  }
+  std::cout << std::endl;
+  for (size_t row = 0; row < front.size(); row++) {
+    std::cout << std::setw(4) << row;
+    for (size_t k = 0; k < m; k++) {
+      std::cout << std::setw(12) << values[front[row] * m + k];
+    }
+    std::cout << std::endl;
+    std::string path = options.output + "-" + std::to_string(row) + ".tsv";
+    if (!options.output.empty() &&
+        !writePlan(path, graph, nsga.population[front[row]].begin())) {
+      std::cerr << "Plan File: could not write " << path << std::endl;
+      return -4;
+    }
+  }
+  return 0;
+}
+
+template <typename LegIndex>
+std::unique_ptr<SharedIslandSegment>
+attachIslands(const VotingDistrictGraph &graph, const RunOptions &options) {
+  std::unique_ptr<SharedIslandSegment> segment(new SharedIslandSegment(
+      options.shm_name, options.num_islands, options.topology,
+      graph.num_districts, sizeof(LegIndex), 2 * options.num_migrants,
+      graph.fingerprint(), options.run_id));
+  if (!segment->ok()) {
+    std::cerr << "Shared Memory: " << segment->error << std::endl;
+    segment.reset();
+  }
+  return segment;
+}
+
+/* One island of a multi-process run. A restarted island reseeds from the
+ * best plan it last published and carries on after the last generation it
+ * completed.
+ */
+template <typename LegIndex>
+int runIsland(const VotingDistrictGraph &graph, const RunOptions &options) {
+  typedef PrecinctGene<LegIndex> Gene;
+  if (options.island >= options.num_islands) {
+    std::cerr << "Shared Memory: island " << options.island
+              << " is not below --islands " << options.num_islands
+              << std::endl;
+    return -6;
+  }
+  auto segment = attachIslands<LegIndex>(graph, options);
+  if (!segment) {
+    return -6;
+  }
+
+  std::cout << "seed " << options.seed << std::endl;
+  unsigned int island = options.island;
+  VotingDistrictObjective<LegIndex> objective(graph);
+  auto crosser = newCrosser<LegIndex>(graph, options);
+  auto mutator = newMutator<LegIndex>(graph, options);
+  auto selector = options.selector();
+  PlanPopulation<LegIndex> seed(graph, 1);
+  std::vector<LegIndex> genes(graph.num_districts);
+  int score;
+  uint32_t generation = 0;
+  segment->recover(island);
+  if (segment->snapshot(island, score, generation, genes.data())) {
+    seed.load(0, genes.data());
+    generation = segment->completed(island);
+  } else {
+    generation = 0;
+  }
+
+  ScoreFile scores(options.scorePath(), graph.fingerprint(),
+                   objective.version);
+  if (!scores.ok()) {
+    std::cerr << "Score File: " << scores.error << std::endl;
+    return -4;
+  }
+  auto cache = options.scoreCache(scores);
+  GeneticAlgorithm<Gene> ga(seed[0], options.gaConfig(cache.get(), island),
+                            objective, *crosser, *mutator, *selector);
+  ga.generation_count = generation;
+  segment->setState(island, SharedIslandSegment::running);
+
+  std::vector<size_t> elites;
+  PlanPopulation<LegIndex> arrival(graph, 1);
+  int published = INT_MAX;
+  auto publish = [&](uint32_t g) {
+    ga.elites(1, elites);
+    if (ga.scores[elites[0]] < published) {
+      published = ga.scores[elites[0]];
+      segment->publish(island, published, g, ga.population[elites[0]].begin());
+    }
+  };
+  for (uint32_t g = generation + 1; g <= options.generations; g++) {
+    ga.generation();
+    segment->complete(island, g);
+    if (!options.migration_interval || g % options.migration_interval) {
+      continue;
+    }
+    ga.elites(options.num_migrants, elites);
+    for (size_t e = 0; e < segment->edges.size(); e++) {
+      if (segment->edges[e].first == island) {
+        for (size_t slot : elites) {
+          segment->send(e, ga.scores[slot], ga.population[slot].begin());
+        }
+      }
+    }
+    for (size_t e = 0; e < segment->edges.size(); e++) {
+      if (segment->edges[e].second != island) {
+        continue;
+      }
+      while (segment->receive(e, score, genes.data())) {
+        arrival.load(0, genes.data());
+        size_t worst = std::max_element(ga.scores.begin(), ga.scores.end()) -
+                       ga.scores.begin();
+        ga.replace(worst, arrival, 0, score);
+      }
+    }
+    publish(g);
+  }
+  publish(std::max(generation, options.generations));
+  segment->setState(island, SharedIslandSegment::finished);
+  if (cache && !scores.save(*cache)) {
+    std::cerr << "Score File: could not write " << options.score_file
+              << std::endl;
+    return -4;
+  }
+  return 0;
+}
+
+/* Watches the islands of a multi-process run, reporting each improvement
+ * of the global best, until every island has finished. The best plan is
+ * written to --output if given and the segment is then removed.
+ */
+template <typename LegIndex>
+int coordinate(const VotingDistrictGraph &graph, const RunOptions &options) {
+  auto segment = attachIslands<LegIndex>(graph, options);
+  if (!segment) {
+    return -6;
+  }
+
+  std::vector<LegIndex> genes(graph.num_districts);
+  std::vector<LegIndex> best_genes(graph.num_districts);
+  int best = INT_MAX;
+  for (bool finished = false; !finished;) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    finished = true;
+    for (unsigned int i = 0; i < options.num_islands; i++) {
+      finished &= segment->state(i) == SharedIslandSegment::finished;
+      int score;
+      uint32_t generation;
+      if (segment->snapshot(i, score, generation, genes.data()) &&
+          score < best) {
+        best = score;
+        best_genes.swap(genes);
+        std::cout << "island " << i << " generation " << generation
+                  << " score " << score << std::endl;
+      }
+    }
+  }
+
+  std::cout << "best score " << best << std::endl;
+  segment->unlink();
+  if (!options.output.empty() &&
+      !writePlan(options.output, graph, best_genes.data())) {
+    std::cerr << "Plan File: could not write " << options.output << std::endl;
+    return -4;
+  }
+  return 0;
+}
+
+struct PlanReport {
+  uint32_t districts;
+  uint32_t unassigned;
+  uint32_t duplicates;
+  uint32_t unknown;
+  uint32_t split;
+  double max_deviation;
+  ParseError error;
+
+  bool valid() const {
+    return error.line.empty() && !error.line_num && !unassigned &&
+           !duplicates && !unknown && !split;
+  }
+};
+
+/* Checks plan files against the district graph. Every worker owns its
+ * scratch arrays and takes the next file from a shared counter; rows are
+ * printed as plans finish.
+ */
+struct PlanValidator {
+  const VotingDistrictGraph &graph;
+  std::unordered_map<int, VotingDistrictIndex> index;
+
+  PlanValidator(const VotingDistrictGraph &graph) : graph(graph) {
+    index.reserve(graph.num_districts);
+    for (VotingDistrictIndex v = 0; v < graph.num_districts; v++) {
+      index.emplace(graph.voting_district_ids[v], v);
+    }
+  }
+
+  int run(char **paths, int num_paths) {
+    std::atomic<int> next(0);
+    std::atomic<int> invalid(0);
+    std::mutex output;
+    std::cout << std::left << std::setw(32) << "plan" << std::right
+              << std::setw(10) << "districts" << std::setw(11) << "unassigned"
+              << std::setw(11) << "duplicates" << std::setw(8) << "unknown"
+              << std::setw(6) << "split" << std::setw(11) << "deviation"
+              << "  status" << std::endl;
+
+    auto work = [&]() {
+      Scratch scratch(graph.num_districts);
+      for (int i = next++; i < num_paths; i = next++) {
+        PlanReport report = check(paths[i], scratch);
+        invalid += !report.valid();
+        std::lock_guard<std::mutex> lock(output);
+        print(paths[i], report);
+      }
+    };
+    unsigned int num_threads = std::max(
+        1u, std::min<unsigned int>(std::thread::hardware_concurrency(),
+                                   num_paths));
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < num_threads; t++) {
+      threads.emplace_back(work);
+    }
+    work();
+    for (auto &t : threads) {
+      t.join();
+    }
+    return invalid ? -5 : 0;
+  }
+
+private:
+  struct Scratch {
+    std::vector<std::pair<int, int>> assignments;
+    std::vector<int32_t> districts;
+    std::vector<VotingDistrictIndex> parents;
+    std::vector<int> leg_ids;
+    std::vector<int64_t> populations;
+    std::vector<uint32_t> pieces;
+
+    Scratch(size_t num_districts)
+        : districts(num_districts), parents(num_districts) {}
+  };
+
+  VotingDistrictIndex find(Scratch &scratch, VotingDistrictIndex v) {
+    while (scratch.parents[v] != v) {
+      v = scratch.parents[v] = scratch.parents[scratch.parents[v]];
+    }
+    return v;
+  }
+
+  PlanReport check(const char *path, Scratch &scratch) {
+    PlanReport report = PlanReport();
+    scratch.assignments.clear();
+    if (!loadPlanAssignments(path, scratch.assignments, report.error, 1)) {
+      return report;
+    }
+
+    scratch.leg_ids.clear();
+    for (auto &assignment : scratch.assignments) {
+      scratch.leg_ids.push_back(assignment.second);
+    }
+    std::sort(scratch.leg_ids.begin(), scratch.leg_ids.end());
+    scratch.leg_ids.erase(
+        std::unique(scratch.leg_ids.begin(), scratch.leg_ids.end()),
+        scratch.leg_ids.end());
+    report.districts = scratch.leg_ids.size();
+
+    std::fill(scratch.districts.begin(), scratch.districts.end(), -1);
+    for (auto &assignment : scratch.assignments) {
+      auto found = index.find(assignment.first);
+      if (found == index.end()) {
+        report.unknown++;
+      } else if (scratch.districts[found->second] >= 0) {
+        report.duplicates++;
+      } else {
+        scratch.districts[found->second] =
+            std::lower_bound(scratch.leg_ids.begin(), scratch.leg_ids.end(),
+                             assignment.second) -
+            scratch.leg_ids.begin();
+      }
+    }
+
+    std::iota(scratch.parents.begin(), scratch.parents.end(), 0);
+    scratch.populations.assign(report.districts, 0);
+    scratch.pieces.assign(report.districts, 0);
+    for (VotingDistrictIndex v = 0; v < graph.num_districts; v++) {
+      int32_t leg = scratch.districts[v];
+      if (leg < 0) {
+        report.unassigned++;
+        continue;
+      }
+      scratch.populations[leg] +=
+          graph.republicans[v] + graph.democrats[v] + graph.other[v];
+      for (auto n = graph.neighborsBegin(v); n < graph.neighborsEnd(v); n++) {
+        if (*n < v && scratch.districts[*n] == leg) {
+          scratch.parents[find(scratch, v)] = find(scratch, *n);
+        }
+      }
+    }
+    for (VotingDistrictIndex v = 0; v < graph.num_districts; v++) {
+      if (scratch.districts[v] >= 0 && find(scratch, v) == v) {
+        scratch.pieces[scratch.districts[v]]++;
+      }
+    }
+    for (uint32_t pieces : scratch.pieces) {
+      report.split += pieces > 1;
+    }
+
+    if (report.districts > 0) {
+      double ideal = std::accumulate(scratch.populations.begin(),
+                                     scratch.populations.end(), 0.0) /
+                     report.districts;
+      for (int64_t population : scratch.populations) {
+        report.max_deviation = std::max(
+            report.max_deviation, std::abs(population - ideal) / ideal);
+      }
+    }
+    return report;
+  }
+
+  void print(const char *path, const PlanReport &report) {
+    std::cout << std::left << std::setw(32) << path << std::right;
+    if (report.error.line_num) {
+      std::cout << "  Line " << report.error.line_num << " is invalid"
+                << std::endl;
+      return;
+    }
+    if (!report.error.line.empty()) {
+      std::cout << "  " << report.error.line << std::endl;
+      return;
+    }
+    std::cout << std::setw(10) << report.districts << std::setw(11)
+              << report.unassigned << std::setw(11) << report.duplicates
+              << std::setw(8) << report.unknown << std::setw(6) << report.split
+              << std::setw(10) << std::fixed << std::setprecision(2)
+              << report.max_deviation * 100 << "%"
+              << (report.valid() ? "  valid" : "  invalid") << std::endl;
+  }
+};
+
+int usage() {
+  std::cerr << "Usage: gendist [options]" << std::endl
+            << "       gendist --compile [graph file]" << std::endl
+            << "       gendist validate [--graph PATH] plan..." << std::endl
+            << "       gendist island --island I [options]" << std::endl
+            << "       gendist coordinator [--output plan] [options]"
+            << std::endl
+            << "       gendist recom [--steps N] [--output plan] [options]"
+            << std::endl
+            << "       gendist anneal [--steps N] [--replicas N]"
+            << " [--swap-interval N]" << std::endl
+            << "                      [--t-max F] [--t-min F]"
+            << " [--output plan] [options]" << std::endl
+            << "       gendist pareto [--output prefix] [options]"
+            << std::endl
+            << "Options: --generations N --population N --threads N"
+            << " --islands N --topology ring|torus|complete" << std::endl
+            << "         --migration-interval N --migrants N --seed N"
+            << " --shm NAME --run N" << std::endl
+            << "         --graph PATH (default voting_districts.bin)"
+            << std::endl
+            << "         --selection tournament|rank|proportional"
+            << " --tournament N" << std::endl
+            << "         --elites N --replacement generational|truncation"
+            << std::endl
+            << "         --crossover region|one-point --mutation flip|recom"
+            << " --tolerance F" << std::endl
+            << "         --schedule dynamic|static"
+            << " --cache N --clones keep|remove" << std::endl
+            << "         --score-file PATH (keeps scores across runs)"
+            << std::endl;
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  std::string mode = argc > 1 ? argv[1] : "";
+  bool compile = mode == "--compile";
+  bool validate = mode == "validate";
+  bool subcommand = mode == "island" || mode == "coordinator" ||
+                    mode == "recom" || mode == "anneal" || mode == "pareto";
+  RunOptions options;
+  int plans = 2;
+  if (compile) {
+    if (argc > 2) {
+      options.graph_path = argv[2];
+    }
+  } else if (validate) {
+    if (argc > 3 && std::string(argv[2]) == "--graph") {
+      options.graph_path = argv[3];
+      plans = 4;
+    }
+  } else if (!options.parse(argc - 1 - subcommand, argv + 1 + subcommand)) {
+    return usage();
+  }
+  const std::string &graph_path = options.graph_path;
+
+  VotingDistrictGraph graph;
+  bool cached = !compile &&
+                newerThan(graph_path.c_str(), "voting_districts.tsv") &&
+                newerThan(graph_path.c_str(), "voting_district_neigbors.tsv");
+  if (cached && !graph.read(graph_path)) {
+    std::cerr << "Graph File: " << graph_path
+              << " is invalid, reparsing districts" << std::endl;
+    cached = false;
+  }
+  if (!cached) {
+    int status = loadVotingDistrictGraph(graph);
+    if (status) {
+      return status;
+    }
+  }
+  if (compile) {
+    if (!graph.write(graph_path)) {
+      std::cerr << "Graph File: could not write " << graph_path << std::endl;
+      return -4;
+    }
+    return 0;
+  }
+  if (validate) {
+    return PlanValidator(graph).run(argv + plans, argc - plans);
+  }
+
+  if (graph.num_leg_districts > UINT16_MAX + 1) {
+    std::cerr << "District File: " << graph.num_leg_districts
+              << " legislative districts is more than supported" << std::endl;
+    return -2;
+  }
+  bool wide = graph.num_leg_districts > UINT8_MAX + 1;
+  if (mode == "island") {
+    return wide ? runIsland<uint16_t>(graph, options)
+                : runIsland<uint8_t>(graph, options);
+  }
+  if (mode == "pareto") {
+    return wide ? runPareto<uint16_t>(graph, options)
+                : runPareto<uint8_t>(graph, options);
+  }
+  if (mode == "anneal") {
+    return wide ? runAnnealer<uint16_t>(graph, options)
+                : runAnnealer<uint8_t>(graph, options);
+  }
+  if (mode == "recom") {
+    return wide ? runChain<uint16_t>(graph, options)
+                : runChain<uint8_t>(graph, options);
+  }
+  if (mode == "coordinator") {
+    return wide ? coordinate<uint16_t>(graph, options)
+                : coordinate<uint8_t>(graph, options);
+  }
+  return wide ? optimize<uint16_t>(graph, options)
+              : optimize<uint8_t>(graph, options);
 }